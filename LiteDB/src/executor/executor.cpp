@@ -13,7 +13,22 @@ namespace litedb {
 
 void Executor::init() { opTree_ = generateOperator(planTree_); }
 
-bool Executor::exec() { return opTree_->exec(); }
+// 事务之外每条语句都是一个单独的事务，执行完就提交，失败的语句先撤销已经
+// 做的修改，补偿的日志和语句的日志一起提交；事务中的修改在 COMMIT 或
+// ROLLBACK 之后提交，回滚的修改同样写入日志。混合布局的表在事务之外的
+// 语句提交之后合并 delta，合并不会改变行的位置。
+bool Executor::exec() {
+  bool in_trx = g_transaction.inTransaction();
+  if (!in_trx) g_transaction.beginStatement();
+  bool ret = opTree_->exec();
+  // BEGIN 开始了事务，或者 COMMIT/ROLLBACK 失败，事务仍然打开
+  if (g_transaction.inTransaction()) return ret;
+  if (!in_trx &&
+      (ret ? g_transaction.rollback() : g_transaction.endStatement()))
+    return true;
+  if (g_meta_data.commit() || g_meta_data.mergeDelta()) return true;
+  return ret;
+}
 
 BaseOperator* Executor::generateOperator(Plan* plan) {
   BaseOperator* op = nullptr;
@@ -44,7 +59,10 @@ BaseOperator* Executor::generateOperator(Plan* plan) {
       break;
     case kScan: {
       ScanPlan* scan_plan = static_cast<ScanPlan*>(plan);
-      if (scan_plan->type == kSeqScan) op = new SeqScanOperator(plan, next);
+      if (scan_plan->type == kSeqScan)
+        op = new SeqScanOperator(plan, next);
+      else
+        op = new IndexScanOperator(plan, next);
       break;
     }
     case kFilter:
@@ -56,6 +74,9 @@ BaseOperator* Executor::generateOperator(Plan* plan) {
     case kShow:
       op = new ShowOperator(plan, next);
       break;
+    case kUtility:
+      op = new UtilityOperator(plan, next);
+      break;
     default:
       std::cout << "[LiteDB-Error]  Not support plan node "
                 << PlanTypeToString(plan->plan_type);
@@ -69,9 +90,7 @@ bool CreateOperator::exec(TupleIter** iter) {
   CreatePlan* plan = static_cast<CreatePlan*>(plan_);
 
   if (plan->type == kCreateTable) {
-    Table* table = new Table(plan->schema, plan->name, plan->columns);
-    if (g_meta_data.insertTable(table)) {
-      delete table;
+    if (g_meta_data.getTable(plan->schema, plan->name) != nullptr) {
       if (plan->if_not_exists) {
         std::cout << "[LiteDB-Info]  Table "
                   << TableNameToString(plan->schema, plan->name)
@@ -85,14 +104,19 @@ bool CreateOperator::exec(TupleIter** iter) {
       }
     }
 
-    if (g_transaction.inTransaction()) {
-      char* schema = new char[strlen(plan->schema)];
-      char* table_name = new char[strlen(plan->name)];
-      strcpy(schema, plan->schema);
-      strcpy(table_name, plan->name);
-      g_transaction.addCreateTableUndo(schema, table_name);
+    // 建表失败时留下的数据文件在下次删除表或启动时清理
+    Table* table = new Table(g_meta_data.newTableId(), plan->schema,
+                             plan->name, plan->columns, g_default_layout,
+                             g_dict_encoding);
+    if (table->open() || g_meta_data.insertTable(table)) {
+      delete table;
+      return true;
     }
 
+    if (g_transaction.inTransaction())
+      g_transaction.addCreateTableUndo(strdup(plan->schema),
+                                       strdup(plan->name));
+
     std::cout << "[LiteDB-Info]  Create table successfully.\r\n";
     return false;
   } else if (plan->type == kCreateIndex) {
@@ -104,7 +128,8 @@ bool CreateOperator::exec(TupleIter** iter) {
       return true;
     }
 
-    Index* index = table->getIndex(plan->index_name);
+    // 索引名在所有表中唯一，DROP INDEX 只指定索引名
+    Index* index = g_meta_data.getIndex(plan->index_name);
     if (index != nullptr) {
       if (plan->if_not_exists) {
         std::cout << "[LiteDB-Info]  Index " << plan->index_name
@@ -117,21 +142,18 @@ bool CreateOperator::exec(TupleIter** iter) {
       }
     }
 
-    index = new Index();
-    index->name = plan->index_name;
-    index->columns = *plan->index_columns;
-    table->addIndex(index);
-
-    if (g_transaction.inTransaction()) {
-      char* schema = new char[strlen(plan->schema)];
-      char* table_name = new char[strlen(plan->name)];
-      char* index_name = new char[strlen(plan->index_name)];
-      strcpy(schema, plan->schema);
-      strcpy(table_name, plan->name);
-      strcpy(index_name, plan->index_name);
-      g_transaction.addCreateIndexUndo(schema, table_name, index_name);
+    index = table->newIndex(plan->index_name, *plan->index_columns,
+                            plan->index_type);
+    if (g_meta_data.createIndex(table, index)) {
+      delete index;
+      return true;
     }
 
+    if (g_transaction.inTransaction())
+      g_transaction.addCreateIndexUndo(strdup(plan->schema),
+                                       strdup(plan->name),
+                                       strdup(plan->index_name));
+
     std::cout << "[LiteDB-Info]  Create index successfully.\r\n";
   } else {
     std::cout << "[LiteDB-Error]  Invalid 'create' statement.\r\n";
@@ -188,9 +210,9 @@ bool DropOperator::exec(TupleIter** iter) {
     std::cout << "[LiteDB-Info]  Drop table successfully.\r\n";
     return false;
   } else if (plan->type == kDropIndex) {
+    Table* table;
     Index* index;
-    if (g_meta_data.dropIndex(plan->schema, plan->name, plan->index_name,
-                              &index)) {
+    if (g_meta_data.dropIndex(plan->index_name, &table, &index)) {
       if (plan->if_exists) {
         std::cout << "[LiteDB-Info]  Index " << plan->index_name
                   << " did not exist.\r\n";
@@ -202,15 +224,11 @@ bool DropOperator::exec(TupleIter** iter) {
       }
     }
 
-    if (g_transaction.inTransaction()) {
-      char* schema = new char[strlen(plan->schema)];
-      char* name = new char[strlen(plan->name)];
-      strcpy(schema, plan->schema);
-      strcpy(name, plan->name);
-      g_transaction.addDropIndexUndo(schema, name, index);
-    } else {
+    if (g_transaction.inTransaction())
+      g_transaction.addDropIndexUndo(strdup(table->schema()),
+                                     strdup(table->name()), index);
+    else
       delete index;
-    }
 
     std::cout << "[LiteDB-Info]  Drop index successfully.\r\n";
     return false;
@@ -225,9 +243,10 @@ bool DropOperator::exec(TupleIter** iter) {
 bool InsertOperator::exec(TupleIter** iter) {
   InsertPlan* plan = static_cast<InsertPlan*>(plan_);
   TableStore* table_store = plan->table->getTableStore();
-  if (table_store->insertTuple(plan->values)) return true;
+  if (table_store->insertBatch(*plan->rows)) return true;
 
-  std::cout << "[LiteDB-Info]  Insert tuple successfully.\r\n";
+  std::cout << "[LiteDB-Info]  Insert " << plan->rows->size()
+            << " tuple successfully.\r\n";
   return false;
 }
 
@@ -244,7 +263,9 @@ bool UpdateOperator::exec(TupleIter** iter) {
     if (tup_iter == nullptr) {
       break;
     } else {
-      table_store->updateTuple(tup_iter->tup, update->idxs, update->values);
+      if (table_store->updateTuple(tup_iter->view.tid(), update->idxs,
+                                   update->values))
+        return true;
       upd_cnt++;
     }
   }
@@ -266,7 +287,7 @@ bool DeleteOperator::exec(TupleIter** iter) {
     if (tup_iter == nullptr) {
       break;
     } else {
-      table_store->deleteTuple(tup_iter->tup);
+      if (table_store->deleteTuple(tup_iter->view.tid())) return true;
       del_cnt++;
     }
   }
@@ -278,7 +299,7 @@ bool DeleteOperator::exec(TupleIter** iter) {
 
 bool SelectOperator::exec(TupleIter** iter) {
   SelectPlan* plan = static_cast<SelectPlan*>(plan_);
-  std::vector<std::vector<Expr*>> tuples;
+  std::vector<TupleView> tuples;
   while (true) {
     TupleIter* tup_iter = nullptr;
     if (next_->exec(&tup_iter)) return true;
@@ -286,7 +307,7 @@ bool SelectOperator::exec(TupleIter** iter) {
     if (tup_iter == nullptr)
       break;
     else
-      tuples.emplace_back(tup_iter->values);
+      tuples.emplace_back(tup_iter->view);
   }
 
   PrintTuples(plan->out_cols, plan->col_ids, tuples);
@@ -296,28 +317,57 @@ bool SelectOperator::exec(TupleIter** iter) {
 bool SeqScanOperator::exec(TupleIter** iter) {
   ScanPlan* plan = static_cast<ScanPlan*>(plan_);
   TableStore* table_store = plan->table->getTableStore();
-  Tuple* tup = nullptr;
+  FilterPlan* filter = plan->filter;
+  TupleId tid = next_tuple_;
+
+  while (true) {
+    bool found = false;
+    if (!finish_ && table_store->seqScan(tid, &found)) return true;
+    if (!found) {
+      finish_ = true;
+      *iter = nullptr;
+      return false;
+    }
 
-  if (finish_) return false;
+    if (filter == nullptr || filter->op != kOpEquals ||
+        tid.group == matched_group_)
+      break;
+    // 进入新的 tuple group 时先检查 zone map，不可能满足过滤条件时跳过整组
+    if (table_store->groupMayEqual(tid.group, filter->idx, filter->val)) {
+      matched_group_ = tid.group;
+      break;
+    }
+    tid = {tid.group + 1, 0};
+  }
+
+  tuple_.view.reset(tid);
+  *iter = &tuple_;
+
+  next_tuple_ = {tid.group, tid.slot + 1};
 
-  if (next_tuple_ == nullptr)
-    tup = table_store->seqScan(nullptr);
-  else
-    tup = next_tuple_;
+  return false;
+}
+
+bool IndexScanOperator::exec(TupleIter** iter) {
+  ScanPlan* plan = static_cast<ScanPlan*>(plan_);
+  TableStore* table_store = plan->table->getTableStore();
+  FilterPlan* filter = plan->filter;
 
-  if (tup == nullptr) {
+  if (!started_) {
+    std::string key;
+    if (!table_store->encodeKey(filter->idx, filter->val, &key) &&
+        table_store->indexScan(&plan->index->data, filter->op, key, &tids_))
+      return true;
+    started_ = true;
+  }
+
+  if (pos_ == tids_.size()) {
     *iter = nullptr;
     return false;
   }
 
-  TupleIter* tup_iter = new TupleIter(tup);
-  table_store->parseTuple(tup, tup_iter->values);
-  tuples_.emplace_back(tup_iter);
-  *iter = tup_iter;
-
-  next_tuple_ = table_store->seqScan(tup);
-  if (next_tuple_ == nullptr) finish_ = true;
-
+  tuple_.view.reset(tids_[pos_++]);
+  *iter = &tuple_;
   return false;
 }
 
@@ -329,7 +379,10 @@ bool FilterOperator::exec(TupleIter** iter) {
 
     if (tup_iter == nullptr) break;
 
-    if (execEqualExpr(tup_iter)) {
+    FilterPlan* filter = static_cast<FilterPlan*>(plan_);
+    bool match = (filter->op == kOpEquals) ? execEqualExpr(tup_iter)
+                                           : execCompareExpr(tup_iter);
+    if (match) {
       *iter = tup_iter;
       break;
     }
@@ -340,20 +393,31 @@ bool FilterOperator::exec(TupleIter** iter) {
 
 bool FilterOperator::execEqualExpr(TupleIter* iter) {
   FilterPlan* filter = static_cast<FilterPlan*>(plan_);
-  Expr* val = filter->val;
-  size_t col_id = filter->idx;
-
-  Expr* col_val = iter->values[col_id];
-  if (col_val->type != val->type) return false;
-
-  if (col_val->type == kExprLiteralInt) return (col_val->ival == val->ival);
+  TableStore* table_store = filter->table->getTableStore();
 
-  if (col_val->type == kExprLiteralFloat) return (col_val->ival == val->ival);
+  // 字典编码的列比较编码，其他列直接比较存储中的列值
+  if (table_store->isEncoded(filter->idx)) {
+    if (!resolved_) {
+      found_ = table_store->lookupCode(filter->idx, filter->val, &code_);
+      resolved_ = true;
+    }
+    return found_ &&
+           table_store->isCodeEqual(iter->view.tid(), filter->idx, code_);
+  }
 
-  if (col_val->type == kExprLiteralString)
-    return (strcmp(col_val->name, val->name) == 0);
+  return table_store->isColumnEqual(iter->view.tid(), filter->idx,
+                                    filter->val);
+}
 
-  return false;
+bool FilterOperator::execCompareExpr(TupleIter* iter) {
+  FilterPlan* filter = static_cast<FilterPlan*>(plan_);
+  TableStore* table_store = filter->table->getTableStore();
+  if (!resolved_) {
+    found_ = !table_store->encodeKey(filter->idx, filter->val, &key_);
+    resolved_ = true;
+  }
+  return found_ && table_store->isColumnMatch(iter->view.tid(), filter->idx,
+                                              filter->op, key_);
 }
 
 bool TrxOperator::exec(TupleIter** iter) {
@@ -373,7 +437,7 @@ bool TrxOperator::exec(TupleIter** iter) {
         std::cout << "[LiteDB-Error]  Not in transaction\r\n";
         return true;
       }
-      g_transaction.commit();
+      if (g_transaction.commit()) return true;
       std::cout << "[LiteDB-Info]  Commit transaction\r\n";
       break;
     }
@@ -382,7 +446,7 @@ bool TrxOperator::exec(TupleIter** iter) {
         std::cout << "[LiteDB-Error]  Not in transaction\r\n";
         return true;
       }
-      g_transaction.rollback();
+      if (g_transaction.rollback()) return true;
       std::cout << "[LiteDB-Info]  Rollback transaction\r\n";
       break;
     }
@@ -423,6 +487,10 @@ bool ShowOperator::exec(TupleIter** iter) {
       else
         std::cout << col_def->name << "\t"
                   << DataTypeToString(col_def->type.data_type) << "\r\n";
+  } else if (show_plan->type == kShowTableStatus) {
+    return showTableStatus(show_plan);
+  } else if (show_plan->type == kShowStats) {
+    return showStats(show_plan);
   } else {
     std::cout << "[LiteDB-Error]  Invalid 'Show' statement.\r\n";
     return true;
@@ -431,4 +499,126 @@ bool ShowOperator::exec(TupleIter** iter) {
   return false;
 }
 
+// 每张表输出一行，空间占用的单位是字节
+bool ShowOperator::showTableStatus(ShowPlan* plan) {
+  static const char* layout_names[] = {"row", "pax", "hybrid"};
+  std::vector<Table*> tables;
+  if (plan->name == nullptr) {
+    g_meta_data.getAllTables(&tables);
+  } else {
+    Table* table = g_meta_data.getTable(plan->schema, plan->name);
+    if (table == nullptr) {
+      std::cout << "[LiteDB-Error]  Failed to find table "
+                << TableNameToString(plan->schema, plan->name) << "\r\n";
+      return true;
+    }
+    tables.emplace_back(table);
+  }
+
+  std::cout << "# Table Status:\r\n";
+  std::cout << "Name\tLayout\tRows\tGroups\tData\tFree\tStrings\tDict\t"
+               "Index\tCached\tDisk\r\n";
+  for (auto table : tables) {
+    TableStore* table_store = table->getTableStore();
+    TableStatus status;
+    if (table_store->status(&status)) return true;
+    std::cout << TableNameToString(table->schema(), table->name()) << "\t"
+              << layout_names[table_store->layout()] << "\t" << status.rows
+              << "\t" << status.groups << "\t" << status.data_bytes << "\t"
+              << status.free_bytes << "\t" << status.string_bytes << "\t"
+              << status.dict_bytes << "\t" << status.index_bytes << "\t"
+              << status.cached_bytes << "\t" << status.disk_bytes << "\r\n";
+  }
+
+  return false;
+}
+
+// 每列输出一行，Min、Max 和 Buckets 只对有直方图的数值列有意义
+bool ShowOperator::showStats(ShowPlan* plan) {
+  Table* table = g_meta_data.getTable(plan->schema, plan->name);
+  if (table == nullptr) {
+    std::cout << "[LiteDB-Error]  Failed to find table "
+              << TableNameToString(plan->schema, plan->name) << "\r\n";
+    return true;
+  }
+
+  TableStats* stats = table->getTableStore()->stats();
+  if (!stats->analyzed()) {
+    std::cout << "[LiteDB-Info]  Table "
+              << TableNameToString(plan->schema, plan->name)
+              << " has not been analyzed.\r\n";
+    return false;
+  }
+
+  std::cout << "# Stats of " << TableNameToString(plan->schema, plan->name)
+            << ": " << stats->rowCount() << " rows"
+            << (stats->stale() ? " (stale, run ANALYZE to refresh)" : "")
+            << "\r\n";
+  std::cout << "Column\tNulls\tDistinct\tMin\tMax\tBuckets\r\n";
+  std::vector<ColumnDefinition*>* columns = table->columns();
+  for (size_t i = 0; i < columns->size(); i++) {
+    const Histogram& histogram = stats->histogram(i);
+    std::cout << (*columns)[i]->name << "\t" << stats->nullCount(i) << "\t"
+              << static_cast<int64_t>(stats->distinctCount(i) + 0.5);
+    if (histogram.bounds.empty())
+      std::cout << "\t-\t-\t0\r\n";
+    else
+      std::cout << "\t" << histogram.min << "\t" << histogram.bounds.back()
+                << "\t" << histogram.bounds.size() << "\r\n";
+  }
+
+  return false;
+}
+
+bool UtilityOperator::exec(TupleIter** iter) {
+  UtilityPlan* plan = static_cast<UtilityPlan*>(plan_);
+  switch (plan->type) {
+    case kUtilityCheckpoint:
+      if (g_meta_data.checkpoint()) return true;
+      std::cout << "[LiteDB-Info]  Checkpoint successfully.\r\n";
+      break;
+    case kUtilityVacuum: {
+      // 移动的行可能被事务的 undo 引用
+      if (g_transaction.inTransaction()) {
+        std::cout << "[LiteDB-Error]  VACUUM can not run inside a "
+                     "transaction.\r\n";
+        return true;
+      }
+      VacuumStats stats;
+      if (g_meta_data.vacuum(plan->table, plan->freeze, &stats)) return true;
+      std::cout << "[LiteDB-Info]  Vacuum successfully, " << stats.moved
+                << " rows moved, " << stats.freed << " pages freed";
+      if (stats.merged > 0)
+        std::cout << ", " << stats.merged << " pages merged";
+      if (plan->freeze) std::cout << ", " << stats.frozen << " pages frozen";
+      std::cout << ".\r\n";
+      break;
+    }
+    case kUtilityTruncate: {
+      Table* table;
+      if (g_meta_data.truncateTable(plan->table->schema(),
+                                    plan->table->name(), &table))
+        return true;
+      if (g_transaction.inTransaction())
+        g_transaction.addTruncateTableUndo(table);
+      else
+        delete table;
+      std::cout << "[LiteDB-Info]  Truncate table successfully.\r\n";
+      break;
+    }
+    case kUtilityAnalyze: {
+      int64_t rows;
+      if (g_meta_data.analyze(plan->table, &rows)) return true;
+      std::cout << "[LiteDB-Info]  Analyze successfully, " << rows
+                << " rows.\r\n";
+      break;
+    }
+    default:
+      std::cout << "[LiteDB-Error]  Invalid utility statement.\r\n";
+      return true;
+  }
+
+  return false;
+}
+
 }  // namespace litedb
\ No newline at end of file
@@ -4,14 +4,11 @@
 
 namespace litedb {
 
+// 算子之间传递的元组，通过 view 直接读取存储中的列值
 struct TupleIter {
-  TupleIter(Tuple* t) : tup(t) {}
-  ~TupleIter() {
-    for (auto expr : values) delete expr;
-  }
+  TupleIter(TableStore* table_store, TupleId tid) : view(table_store, tid) {}
 
-  Tuple* tup;
-  std::vector<Expr*> values;
+  TupleView view;
 };
 
 class BaseOperator {
@@ -71,6 +68,18 @@ class ShowOperator : public BaseOperator {
   ShowOperator(Plan* plan, BaseOperator* next) : BaseOperator(plan, next) {}
   ~ShowOperator() {}
   bool exec(TupleIter** iter = nullptr) override;
+
+ private:
+  bool showTableStatus(ShowPlan* plan);
+  bool showStats(ShowPlan* plan);
+};
+
+class UtilityOperator : public BaseOperator {
+ public:
+  UtilityOperator(Plan* plan, BaseOperator* next)
+      : BaseOperator(plan, next) {}
+  ~UtilityOperator() {}
+  bool exec(TupleIter** iter = nullptr) override;
 };
 
 class SelectOperator : public BaseOperator {
@@ -83,28 +92,61 @@ class SelectOperator : public BaseOperator {
 class SeqScanOperator : public BaseOperator {
  public:
   SeqScanOperator(Plan* plan, BaseOperator* next)
-      : BaseOperator(plan, next), finish_(false), next_tuple_(nullptr) {}
-  ~SeqScanOperator() {
-    for (auto iter : tuples_) {
-      delete iter;
-    }
-  }
+      : BaseOperator(plan, next),
+        finish_(false),
+        next_tuple_({0, 0}),
+        matched_group_(UINT32_MAX),
+        tuple_(static_cast<ScanPlan*>(plan)->table->getTableStore(),
+               {0, 0}) {}
+  ~SeqScanOperator() {}
   bool exec(TupleIter** iter = nullptr) override;
 
  private:
   bool finish_;
-  Tuple* next_tuple_;
-  std::vector<TupleIter*> tuples_;
+  TupleId next_tuple_;
+  // 已经通过 zone map 检查的 tuple group
+  uint32_t matched_group_;
+  // 每次返回同一个 TupleIter，上层算子需要在下一次调用前使用完
+  TupleIter tuple_;
+};
+
+// 第一次调用时通过索引找出所有满足过滤条件的行，之后逐行返回。上层算子
+// 修改这些行时索引随之变化，先收集可以保证每行只返回一次
+class IndexScanOperator : public BaseOperator {
+ public:
+  IndexScanOperator(Plan* plan, BaseOperator* next)
+      : BaseOperator(plan, next),
+        started_(false),
+        pos_(0),
+        tuple_(static_cast<ScanPlan*>(plan)->table->getTableStore(),
+               {0, 0}) {}
+  ~IndexScanOperator() {}
+  bool exec(TupleIter** iter = nullptr) override;
+
+ private:
+  bool started_;
+  size_t pos_;
+  std::vector<TupleId> tids_;
+  TupleIter tuple_;
 };
 
 class FilterOperator : public BaseOperator {
  public:
-  FilterOperator(Plan* plan, BaseOperator* next) : BaseOperator(plan, next) {}
+  FilterOperator(Plan* plan, BaseOperator* next)
+      : BaseOperator(plan, next), resolved_(false), found_(false), code_(0) {}
   ~FilterOperator() {}
   bool exec(TupleIter** iter = nullptr) override;
 
  private:
   bool execEqualExpr(TupleIter* iter);
+  bool execCompareExpr(TupleIter* iter);
+
+  // 字典编码的列在第一次比较时查出常量的编码，其他比较在第一次比较时把
+  // 常量编码成 key_
+  bool resolved_;
+  bool found_;
+  uint32_t code_;
+  std::string key_;
 };
 
 class Executor {
@@ -2,6 +2,7 @@
 
 #include <iostream>
 
+#include "parser/parser.h"
 #include "util.h"
 
 using namespace hsql;
@@ -27,6 +28,9 @@ Plan* Optimizer::createPlanTree(const SQLStatement* stmt) {
       return createTrxPlanTree(static_cast<const TransactionStatement*>(stmt));
     case kStmtShow:
       return createShowPlanTree(static_cast<const ShowStatement*>(stmt));
+    case kStmtUtility:
+      return createUtilityPlanTree(
+          static_cast<const UtilityStatement*>(stmt));
     default:
       std::cout << "[LiteDB-Error]  Statement type "
                 << StmtTypeToString(stmt->type())
@@ -47,9 +51,11 @@ Plan* Optimizer::createSelectPlanTree(const SelectStatement* stmt) {
   plan = scan;
 
   if (stmt->whereClause != nullptr) {
-    Plan* filter = createFilterPlan(columns, stmt->whereClause);
+    Plan* filter = createFilterPlan(table, stmt->whereClause);
     filter->next = plan;
     plan = filter;
+    scan->filter = static_cast<FilterPlan*>(filter);
+    chooseIndex(scan);
   }
 
   SelectPlan* select = new SelectPlan();
@@ -81,7 +87,8 @@ Plan* Optimizer::createInsertPlanTree(const InsertStatement* stmt) {
   InsertPlan* plan = new InsertPlan();
   plan->type = stmt->type;
   plan->table = g_meta_data.getTable(stmt->schema, stmt->tableName);
-  plan->values = stmt->values;
+  // Parser 已经把 INSERT ... VALUES 统一转换成 InsertRowsStatement
+  plan->rows = &static_cast<const InsertRowsStatement*>(stmt)->rows;
 
   return plan;
 }
@@ -96,9 +103,11 @@ Plan* Optimizer::createUpdatePlanTree(const UpdateStatement* stmt) {
   plan = scan;
 
   if (stmt->where != nullptr) {
-    Plan* filter = createFilterPlan(table->columns(), stmt->where);
+    Plan* filter = createFilterPlan(table, stmt->where);
     filter->next = plan;
     plan = filter;
+    scan->filter = static_cast<FilterPlan*>(filter);
+    chooseIndex(scan);
   }
 
   UpdatePlan* update = new UpdatePlan();
@@ -130,9 +139,11 @@ Plan* Optimizer::createDeletePlanTree(const DeleteStatement* stmt) {
   plan = scan;
 
   if (stmt->expr != nullptr) {
-    Plan* filter = createFilterPlan(table->columns(), stmt->expr);
+    Plan* filter = createFilterPlan(table, stmt->expr);
     filter->next = plan;
     plan = filter;
+    scan->filter = static_cast<FilterPlan*>(filter);
+    chooseIndex(scan);
   }
 
   DeletePlan* del = new DeletePlan();
@@ -152,6 +163,11 @@ Plan* Optimizer::createCreatePlanTree(const CreateStatement* stmt) {
   plan->next = nullptr;
 
   if (plan->type == kCreateIndex) {
+    // Parser 识别的 CREATE INDEX 带有索引类型
+    auto index_stmt = dynamic_cast<const CreateIndexStatement*>(stmt);
+    plan->index_type =
+        (index_stmt != nullptr) ? index_stmt->index_type : kBTreeIndex;
+
     Table* table = g_meta_data.getTable(plan->schema, plan->name);
     if (table == nullptr) {
       delete plan;
@@ -201,17 +217,46 @@ Plan* Optimizer::createShowPlanTree(const ShowStatement* stmt) {
   return plan;
 }
 
-Plan* Optimizer::createFilterPlan(std::vector<ColumnDefinition*>* columns,
-                                  Expr* where) {
+Plan* Optimizer::createUtilityPlanTree(const UtilityStatement* stmt) {
+  UtilityPlan* plan = new UtilityPlan();
+  plan->type = stmt->type;
+  plan->freeze = stmt->freeze;
+  plan->table = nullptr;
+  if (stmt->name != nullptr)
+    plan->table = g_meta_data.getTable(stmt->schema, stmt->name);
+  return plan;
+}
+
+Plan* Optimizer::createFilterPlan(Table* table, Expr* where) {
+  std::vector<ColumnDefinition*>* columns = table->columns();
   FilterPlan* filter = new FilterPlan();
+  filter->table = table;
   Expr* col = nullptr;
   Expr* val = nullptr;
+  filter->op = where->opType;
   if (where->expr->type == kExprColumnRef) {
     col = where->expr;
     val = where->expr2;
   } else {
     col = where->expr2;
     val = where->expr;
+    // 常量在左边时交换比较的方向
+    switch (where->opType) {
+      case kOpLess:
+        filter->op = kOpGreater;
+        break;
+      case kOpLessEq:
+        filter->op = kOpGreaterEq;
+        break;
+      case kOpGreater:
+        filter->op = kOpLess;
+        break;
+      case kOpGreaterEq:
+        filter->op = kOpLessEq;
+        break;
+      default:
+        break;
+    }
   }
 
   for (size_t i = 0; i < columns->size(); i++) {
@@ -224,4 +269,34 @@ Plan* Optimizer::createFilterPlan(std::vector<ColumnDefinition*>* columns,
 
   return filter;
 }
+
+// B+ 树索引的第一列是过滤的列时可以按范围查找，有多个这样的索引时选择
+// 列数最少的索引。哈希索引只能用于单列的等值查找，可用时优先于 B+ 树
+void Optimizer::chooseIndex(ScanPlan* scan) {
+  FilterPlan* filter = scan->filter;
+  switch (filter->op) {
+    case kOpEquals:
+    case kOpLess:
+    case kOpLessEq:
+    case kOpGreater:
+    case kOpGreaterEq:
+      break;
+    default:
+      return;
+  }
+
+  for (auto index : *scan->table->indexes()) {
+    TableIndex& data = index->data;
+    if (data.cols.front() != filter->idx) continue;
+    if (data.type == kHashIndex) {
+      if (filter->op != kOpEquals || data.cols.size() != 1) continue;
+      scan->index = index;
+      break;
+    }
+    if (scan->index == nullptr ||
+        data.cols.size() < scan->index->data.cols.size())
+      scan->index = index;
+  }
+  if (scan->index != nullptr) scan->type = kIndexScan;
+}
 }  // namespace litedb
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "parser/parser.h"
 #include "sql/statements.h"
 #include "storage/metadata.h"
 
@@ -19,7 +20,8 @@ enum PlanType {
   kSort,
   kLimit,
   kTrx,
-  kShow
+  kShow,
+  kUtility
 };
 
 struct Plan {
@@ -40,6 +42,7 @@ struct CreatePlan : public Plan {
   char* schema;
   char* name;
   char* index_name;
+  IndexType index_type;
   std::vector<ColumnDefinition*>* index_columns;
   std::vector<ColumnDefinition*>* columns;
 };
@@ -57,7 +60,7 @@ struct InsertPlan : public Plan {
   InsertPlan() : Plan(kInsert) {}
   InsertType type;
   Table* table;
-  std::vector<Expr*>* values;
+  const std::vector<std::vector<Expr*>*>* rows;
 };
 
 struct UpdatePlan : public Plan {
@@ -81,15 +84,25 @@ struct SelectPlan : public Plan {
 
 enum ScanType { kSeqScan, kIndexScan };
 
+struct FilterPlan;
+
 struct ScanPlan : public Plan {
-  ScanPlan() : Plan(kScan) {}
+  ScanPlan() : Plan(kScan), filter(nullptr), index(nullptr) {}
   ScanType type;
   Table* table;
+  // 上层的过滤条件，顺序扫描时用于按 zone map 跳过 tuple group，索引扫描时
+  // 用于在 index 中查找
+  FilterPlan* filter;
+  Index* index;
 };
 
+// 第 idx 列和常量 val 的比较，op 是 =、<>、<、<=、> 或 >=
 struct FilterPlan : public Plan {
-  FilterPlan() : Plan(kFilter), idx(0), val(nullptr) {}
+  FilterPlan()
+      : Plan(kFilter), table(nullptr), idx(0), op(kOpEquals), val(nullptr) {}
+  Table* table;
   size_t idx;
+  OperatorType op;
   Expr* val;
 };
 
@@ -117,6 +130,14 @@ struct ShowPlan : public Plan {
   char* name;
 };
 
+struct UtilityPlan : public Plan {
+  UtilityPlan() : Plan(kUtility) {}
+  UtilityType type;
+  bool freeze;
+  // VACUUM 的表，nullptr 表示所有的表
+  Table* table;
+};
+
 class Optimizer {
  public:
   Optimizer() {}
@@ -140,7 +161,13 @@ class Optimizer {
 
   Plan* createShowPlanTree(const ShowStatement* stmt);
 
-  Plan* createFilterPlan(std::vector<ColumnDefinition*>* columns, Expr* where);
+  Plan* createUtilityPlanTree(const UtilityStatement* stmt);
+
+  Plan* createFilterPlan(Table* table, Expr* where);
+
+  // 过滤条件可以通过表上的索引查找时把 scan 改成索引扫描。等值比较优先
+  // 使用单列的哈希索引
+  void chooseIndex(ScanPlan* scan);
 };
 
 }  // namespace litedb
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 #include <termios.h>
 
 #include <iostream>
@@ -7,6 +8,10 @@
 #include "executor/executor.h"
 #include "executor/optimizer.h"
 #include "parser/parser.h"
+#include "storage/buffer_pool.h"
+#include "storage/checkpoint.h"
+#include "storage/metadata.h"
+#include "trx.h"
 
 using namespace litedb;
 using namespace hsql;
@@ -23,6 +28,47 @@ static bool ExecStmt(std::string stmt);
 static void HandleInput();
 
 int main(int argc, char* argv[]) {
+  // --pax: 新建的表使用 PAX 列式布局
+  // --hybrid: 新建的表使用行式 delta 加 PAX main 的混合布局
+  // --dict: 新建的表对 CHAR 列使用字典编码
+  // --data-dir <dir>: 数据目录，默认是当前目录下的 data
+  // --buffer-pool <MB>: 缓冲池的大小
+  // --commit-delay <us>: group commit 合并提交的最长等待时间
+  // --checkpoint-interval <s>: 后台检查点的间隔，0 表示只在日志过大时触发
+  // --mmap: 读为主的模式，缓冲池中没有的页直接读文件映射
+  // --huge-pages: 缓冲池使用预留的大页
+  // --persist-indexes: 检查点之后保存索引，启动时不用扫描表重建
+  // --index-fill <percent>: 批量构建 B+ 树索引时节点的填充率，50 到 100
+  size_t buffer_pool_size = BUFFER_POOL_DEFAULT_SIZE;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--pax") == 0)
+      g_default_layout = kPaxLayout;
+    else if (strcmp(argv[i], "--hybrid") == 0)
+      g_default_layout = kHybridLayout;
+    else if (strcmp(argv[i], "--dict") == 0)
+      g_dict_encoding = true;
+    else if (strcmp(argv[i], "--data-dir") == 0 && i + 1 < argc)
+      g_data_dir = argv[++i];
+    else if (strcmp(argv[i], "--buffer-pool") == 0 && i + 1 < argc)
+      buffer_pool_size = strtoul(argv[++i], nullptr, 10) * 1024 * 1024;
+    else if (strcmp(argv[i], "--commit-delay") == 0 && i + 1 < argc)
+      g_commit_delay = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--checkpoint-interval") == 0 && i + 1 < argc)
+      g_checkpoint_interval = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--mmap") == 0)
+      g_use_mmap = true;
+    else if (strcmp(argv[i], "--huge-pages") == 0)
+      g_huge_pages = true;
+    else if (strcmp(argv[i], "--persist-indexes") == 0)
+      g_persist_indexes = true;
+    else if (strcmp(argv[i], "--index-fill") == 0 && i + 1 < argc)
+      g_index_fill_factor = atoi(argv[++i]);
+  }
+
+  if (g_buffer_pool.init(buffer_pool_size)) return -1;
+  if (g_meta_data.load()) return -1;
+  g_checkpointer.start();
+
   struct termios tm, tm_old;
   int fd = 0;
   // 保存当前终端状态
@@ -38,12 +84,18 @@ int main(int argc, char* argv[]) {
   // 内部循环处理
   HandleInput();
 
+  // 退出时回滚没有提交的事务，并做一次检查点，下次启动不需要恢复。
+  // 回滚失败时不能提交，留给下次启动时恢复
+  g_checkpointer.stop();
+  bool err = (g_transaction.inTransaction() && g_transaction.rollback()) ||
+             g_meta_data.commit() || g_meta_data.checkpoint();
+
   std::cout << "# Bye~\r\n";
 
   // 恢复终端状态
   if (tcsetattr(fd, TCSANOW, &tm_old) < 0) return -1;
 
-  return 0;
+  return err ? -1 : 0;
 }
 
 static bool ExecStmt(std::string stmt) {
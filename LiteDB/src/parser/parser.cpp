@@ -1,7 +1,12 @@
 #include "parser.h"
 
+#include <strings.h>
+
+#include <algorithm>
+#include <cctype>
 #include <cstdint>
 #include <iostream>
+#include <sstream>
 
 #include "storage/metadata.h"
 #include "util.h"
@@ -19,16 +24,301 @@ Parser::~Parser() {
 
 bool Parser::parseStatement(std::string query) {
   result_ = new SQLParserResult;
-  SQLParser::parse(query, result_);
+  if (parseUtilityStatement(query)) return checkStmtsMeta();
+
+  std::vector<size_t> row_cnts;
+  SQLParser::parse(splitInsertRows(query, &row_cnts), result_);
 
-  if (result_->isValid())
+  if (result_->isValid()) {
+    mergeInsertRows(row_cnts);
     return checkStmtsMeta();
-  else
+  } else {
     std::cout << "[LiteDB-Error]  Failed to parse sql statement.\r\n";
+  }
+
+  return true;
+}
+
+// 跳过从 pos 开始的字符串或带引号的标识符，返回结束引号之后的位置
+static size_t SkipQuoted(const std::string& sql, size_t pos) {
+  char quote = sql[pos];
+  for (pos++; pos < sql.size(); pos++) {
+    if (sql[pos] != quote) continue;
+    // 连续两个引号是转义
+    if (pos + 1 < sql.size() && sql[pos + 1] == quote) {
+      pos++;
+      continue;
+    }
+    return pos + 1;
+  }
+
+  return pos;
+}
+
+// 从 pos 开始查找括号外、引号外的字符 c，找不到时返回 sql.size()
+static size_t FindTopLevel(const std::string& sql, size_t pos, char c) {
+  int depth = 0;
+  while (pos < sql.size()) {
+    char ch = sql[pos];
+    if (ch == '\'' || ch == '"') {
+      pos = SkipQuoted(sql, pos);
+      continue;
+    }
+    if (depth == 0 && ch == c) return pos;
+    if (ch == '(') depth++;
+    if (ch == ')') depth--;
+    pos++;
+  }
+
+  return sql.size();
+}
+
+static bool IsWordChar(char c) { return isalnum(c) || c == '_'; }
+
+// 查找括号外、引号外的关键字，返回关键字之后的位置，找不到时返回 0
+static size_t FindKeyword(const std::string& sql, const char* word) {
+  size_t len = strlen(word);
+  size_t pos = 0;
+  while (pos < sql.size()) {
+    char ch = sql[pos];
+    if (ch == '\'' || ch == '"') {
+      pos = SkipQuoted(sql, pos);
+    } else if (ch == '(') {
+      pos = FindTopLevel(sql, pos + 1, ')') + 1;
+    } else if (IsWordChar(ch)) {
+      size_t end = pos;
+      while (end < sql.size() && IsWordChar(sql[end])) end++;
+      if (end - pos == len && strncasecmp(&sql[pos], word, len) == 0)
+        return end;
+      pos = end;
+    } else {
+      pos++;
+    }
+  }
+
+  return 0;
+}
+
+// hsql 不支持 INSERT ... VALUES (...), (...)，把多行 VALUES 拆成多条单行
+// INSERT。row_cnts 按顺序记录每条非空语句拆出的语句数。
+std::string Parser::splitInsertRows(const std::string& query,
+                                    std::vector<size_t>* row_cnts) {
+  std::string sql;
+  size_t begin = 0;
+  while (begin < query.size()) {
+    size_t end = FindTopLevel(query, begin, ';');
+    std::string stmt = query.substr(begin, end - begin);
+    begin = end + 1;
+
+    size_t first = stmt.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos) continue;
+
+    // 依次找出 VALUES 之后每一行的括号
+    std::vector<std::string> rows;
+    size_t head_end = 0;
+    if (strncasecmp(&stmt[first], "insert", 6) == 0)
+      head_end = FindKeyword(stmt, "values");
+    size_t pos = head_end;
+    while (head_end > 0) {
+      pos = stmt.find_first_not_of(" \t\r\n", pos);
+      if (pos == std::string::npos || stmt[pos] != '(') break;
+
+      size_t close = FindTopLevel(stmt, pos + 1, ')');
+      if (close == stmt.size()) break;
+      rows.emplace_back(stmt.substr(pos, close - pos + 1));
+
+      pos = stmt.find_first_not_of(" \t\r\n", close + 1);
+      if (pos == std::string::npos || stmt[pos] != ',') break;
+      pos++;
+    }
+
+    if (rows.size() > 1 && pos == std::string::npos) {
+      std::string head = stmt.substr(0, head_end);
+      for (auto& row : rows) sql += head + " " + row + ";";
+      row_cnts->push_back(rows.size());
+    } else {
+      sql += stmt + ";";
+      row_cnts->push_back(1);
+    }
+  }
+
+  return sql;
+}
+
+// 把 splitInsertRows 拆出的单行 INSERT 合并成 InsertRowsStatement，单行的
+// INSERT 也统一转换，之后的检查和执行只处理 InsertRowsStatement
+void Parser::mergeInsertRows(const std::vector<size_t>& row_cnts) {
+  std::vector<SQLStatement*> stmts = result_->releaseStatements();
+
+  // 拆分的结果和解析出的语句数对不上时，每条语句单独处理
+  size_t total = 0;
+  for (auto cnt : row_cnts) total += cnt;
+  std::vector<size_t> cnts = row_cnts;
+  if (total != stmts.size()) cnts.assign(stmts.size(), 1);
+
+  size_t pos = 0;
+  for (auto cnt : cnts) {
+    InsertStatement* insert = static_cast<InsertStatement*>(stmts[pos]);
+    if (stmts[pos]->type() != kStmtInsert || insert->type != kInsertValues) {
+      for (size_t i = 0; i < cnt; i++) result_->addStatement(stmts[pos + i]);
+      pos += cnt;
+      continue;
+    }
+
+    InsertRowsStatement* rows_stmt = new InsertRowsStatement();
+    rows_stmt->schema = insert->schema;
+    rows_stmt->tableName = insert->tableName;
+    rows_stmt->columns = insert->columns;
+    insert->schema = nullptr;
+    insert->tableName = nullptr;
+    insert->columns = nullptr;
+
+    for (size_t i = 0; i < cnt; i++) {
+      insert = static_cast<InsertStatement*>(stmts[pos + i]);
+      rows_stmt->rows.emplace_back(insert->values);
+      insert->values = nullptr;
+      delete insert;
+    }
+
+    result_->addStatement(rows_stmt);
+    pos += cnt;
+  }
+}
+
+// 把 schema.table 或 table 拆成 schema 和 name，没有 schema 时为 nullptr
+static void ParseTableName(const std::string& str, char** schema,
+                           char** name) {
+  size_t dot = str.find('.');
+  if (dot != std::string::npos) {
+    *schema = strdup(str.substr(0, dot).c_str());
+    *name = strdup(str.substr(dot + 1).c_str());
+  } else {
+    *name = strdup(str.c_str());
+  }
+}
 
+// 识别 CHECKPOINT、VACUUM [FREEZE] [schema.table]、ANALYZE [schema.table]、
+// TRUNCATE [TABLE] schema.table、SHOW TABLE STATUS [schema.table]、
+// SHOW STATS schema.table、CREATE INDEX 等命令，识别成功时返回 true。hsql
+// 把 TRUNCATE 解析成不带条件的 DELETE，这里先识别，使用单独的快速路径
+bool Parser::parseUtilityStatement(const std::string& query) {
+  size_t end = query.find_last_not_of(" \t\r\n;");
+  if (end == std::string::npos) return false;
+
+  std::istringstream in(query.substr(0, end + 1));
+  std::vector<std::string> words;
+  std::string word;
+  while (in >> word) words.emplace_back(word);
+  auto is_word = [&words](size_t i, const char* str) {
+    return i < words.size() && strcasecmp(words[i].c_str(), str) == 0;
+  };
+
+  SQLStatement* stmt;
+  if (is_word(0, "CHECKPOINT") && words.size() == 1) {
+    stmt = new UtilityStatement(kUtilityCheckpoint);
+  } else if (is_word(0, "VACUUM")) {
+    size_t pos = is_word(1, "FREEZE") ? 2 : 1;
+    if (words.size() > pos + 1) return false;
+    UtilityStatement* vacuum = new UtilityStatement(kUtilityVacuum);
+    vacuum->freeze = (pos == 2);
+    if (pos < words.size())
+      ParseTableName(words[pos], &vacuum->schema, &vacuum->name);
+    stmt = vacuum;
+  } else if (is_word(0, "ANALYZE") && words.size() <= 2) {
+    UtilityStatement* analyze = new UtilityStatement(kUtilityAnalyze);
+    if (words.size() == 2)
+      ParseTableName(words[1], &analyze->schema, &analyze->name);
+    stmt = analyze;
+  } else if (is_word(0, "TRUNCATE")) {
+    size_t pos = is_word(1, "TABLE") ? 2 : 1;
+    if (words.size() != pos + 1) return false;
+    UtilityStatement* truncate = new UtilityStatement(kUtilityTruncate);
+    ParseTableName(words[pos], &truncate->schema, &truncate->name);
+    stmt = truncate;
+  } else if (is_word(0, "SHOW") && is_word(1, "TABLE") &&
+             is_word(2, "STATUS") && words.size() <= 4) {
+    ShowStatement* show = new ShowStatement(kShowTableStatus);
+    if (words.size() == 4) ParseTableName(words[3], &show->schema, &show->name);
+    stmt = show;
+  } else if (is_word(0, "SHOW") && is_word(1, "STATS") && words.size() == 3) {
+    ShowStatement* show = new ShowStatement(kShowStats);
+    ParseTableName(words[2], &show->schema, &show->name);
+    stmt = show;
+  } else if (is_word(0, "CREATE") && is_word(1, "INDEX")) {
+    stmt = parseCreateIndex(query.substr(0, end + 1));
+    if (stmt == nullptr) return false;
+  } else {
+    return false;
+  }
+
+  result_->addStatement(stmt);
+  result_->setIsValid(true);
   return true;
 }
 
+// CREATE INDEX [IF NOT EXISTS] name ON schema.table (col, ...)
+// [USING BTREE | HASH]。hsql 解析 CREATE INDEX 时会丢掉表的 schema，也不
+// 支持 USING，这里自己识别，格式不对时返回 nullptr 交给 hsql 报错
+CreateStatement* Parser::parseCreateIndex(const std::string& query) {
+  size_t open = query.find('(');
+  size_t close = query.rfind(')');
+  if (open == std::string::npos || close == std::string::npos || close < open)
+    return nullptr;
+
+  std::istringstream tail(query.substr(close + 1));
+  std::vector<std::string> options;
+  std::string option;
+  while (tail >> option) options.emplace_back(option);
+  IndexType index_type = kBTreeIndex;
+  if (!options.empty()) {
+    if (options.size() != 2 || strcasecmp(options[0].c_str(), "USING") != 0)
+      return nullptr;
+    if (strcasecmp(options[1].c_str(), "HASH") == 0)
+      index_type = kHashIndex;
+    else if (strcasecmp(options[1].c_str(), "BTREE") != 0)
+      return nullptr;
+  }
+
+  std::istringstream in(query.substr(0, open));
+  std::vector<std::string> words;
+  std::string word;
+  while (in >> word) words.emplace_back(word);
+  auto is_word = [&words](size_t i, const char* str) {
+    return i < words.size() && strcasecmp(words[i].c_str(), str) == 0;
+  };
+  bool if_not_exists =
+      is_word(2, "IF") && is_word(3, "NOT") && is_word(4, "EXISTS");
+  size_t pos = if_not_exists ? 5 : 2;
+  if (words.size() != pos + 3 || !is_word(pos + 1, "ON")) return nullptr;
+
+  std::string column_list = query.substr(open + 1, close - open - 1);
+  std::vector<std::string> columns;
+  std::istringstream list(column_list);
+  std::string column;
+  while (std::getline(list, column, ',')) {
+    size_t first = column.find_first_not_of(" \t\r\n");
+    size_t last = column.find_last_not_of(" \t\r\n");
+    if (first == std::string::npos) return nullptr;
+    column = column.substr(first, last - first + 1);
+    if (column.find_first_of(" \t\r\n()") != std::string::npos)
+      return nullptr;
+    columns.emplace_back(column);
+  }
+  // getline 会忽略最后一个逗号之后的空串
+  size_t commas = std::count(column_list.begin(), column_list.end(), ',');
+  if (columns.size() != commas + 1) return nullptr;
+
+  CreateIndexStatement* stmt = new CreateIndexStatement();
+  stmt->index_type = index_type;
+  stmt->ifNotExists = if_not_exists;
+  stmt->indexName = strdup(words[pos].c_str());
+  ParseTableName(words[pos + 2], &stmt->schema, &stmt->tableName);
+  stmt->indexColumns = new std::vector<char*>();
+  for (auto& name : columns)
+    stmt->indexColumns->emplace_back(strdup(name.c_str()));
+  return stmt;
+}
+
 bool Parser::checkStmtsMeta() {
   for (size_t i = 0; i < result_->size(); ++i) {
     const SQLStatement* stmt = result_->getStatement(i);
@@ -43,7 +333,12 @@ bool Parser::checkMeta(const SQLStatement* stmt) {
     case kStmtSelect:
       return checkSelectStmt(static_cast<const SelectStatement*>(stmt));
     case kStmtInsert:
-      return checkInsertStmt(static_cast<const InsertStatement*>(stmt));
+      if (static_cast<const InsertStatement*>(stmt)->type == kInsertSelect) {
+        std::cout << "[LiteDB-Error]  Do not support 'INSERT INTO ... SELECT "
+                     "...'.\r\n";
+        return true;
+      }
+      return checkInsertStmt(static_cast<const InsertRowsStatement*>(stmt));
     case kStmtUpdate:
       return checkUpdateStmt(static_cast<const UpdateStatement*>(stmt));
     case kStmtDelete:
@@ -52,6 +347,8 @@ bool Parser::checkMeta(const SQLStatement* stmt) {
       return checkCreateStmt(static_cast<const CreateStatement*>(stmt));
     case kStmtDrop:
       return checkDropStmt(static_cast<const DropStatement*>(stmt));
+    case kStmtUtility:
+      return checkUtilityStmt(static_cast<const UtilityStatement*>(stmt));
     case kStmtTransaction:
     case kStmtShow:
       return false;
@@ -115,11 +412,7 @@ bool Parser::checkSelectStmt(const SelectStatement* stmt) {
   return false;
 }
 
-bool Parser::checkInsertStmt(const InsertStatement* stmt) {
-  if (stmt->type == kInsertSelect)
-    std::cout
-        << "[LiteDB-Error]  Do not support 'INSERT INTO ... SELECT ...'.\r\n";
-
+bool Parser::checkInsertStmt(const InsertRowsStatement* stmt) {
   Table* table = g_meta_data.getTable(stmt->schema, stmt->tableName);
   if (table == nullptr) {
     std::cout << "[LiteDB-Error]  Can not find table "
@@ -131,6 +424,14 @@ bool Parser::checkInsertStmt(const InsertStatement* stmt) {
     for (auto col_name : *stmt->columns)
       if (checkColumn(table, col_name)) return true;
 
+  for (auto row : stmt->rows)
+    if (checkInsertRow(table, stmt, row)) return true;
+
+  return false;
+}
+
+bool Parser::checkInsertRow(Table* table, const InsertRowsStatement* stmt,
+                            std::vector<Expr*>* row) {
   /* 安放数据到每一列对应的位置，没有数据的列填写 NULL */
   std::vector<Expr*> new_values;
   for (size_t i = 0; i < table->columns()->size(); i++) {
@@ -138,17 +439,17 @@ bool Parser::checkInsertStmt(const InsertStatement* stmt) {
     if (stmt->columns != nullptr) {
       size_t j;
       for (j = 0; j < stmt->columns->size(); j++)
-        if (strcmp(col_def->name, (*stmt->columns)[j])) break;
+        if (strcmp(col_def->name, (*stmt->columns)[j]) == 0) break;
 
-      if (j < stmt->columns->size()) {
-        new_values.push_back((*stmt->values)[j]);
+      if (j < stmt->columns->size() && j < row->size()) {
+        new_values.push_back((*row)[j]);
       } else {
         Expr* e = new Expr(kExprLiteralNull);
         new_values.push_back(e);
       }
     } else {
-      if (i < stmt->values->size()) {
-        new_values.push_back((*stmt->values)[i]);
+      if (i < row->size()) {
+        new_values.push_back((*row)[i]);
       } else {
         Expr* e = new Expr(kExprLiteralNull);
         new_values.push_back(e);
@@ -156,9 +457,9 @@ bool Parser::checkInsertStmt(const InsertStatement* stmt) {
     }
   }
 
-  stmt->values->assign(new_values.begin(), new_values.end());
+  row->assign(new_values.begin(), new_values.end());
 
-  if (checkValues(table->columns(), stmt->values)) return true;
+  if (checkValues(table->columns(), row)) return true;
 
   return false;
 }
@@ -197,6 +498,19 @@ bool Parser::checkDeleteStmt(const DeleteStatement* stmt) {
   return false;
 }
 
+bool Parser::checkUtilityStmt(const UtilityStatement* stmt) {
+  if (stmt->name == nullptr) return false;
+
+  if (g_meta_data.getTable(stmt->schema, stmt->name) == nullptr) {
+    std::cout << "[LiteDB-Error]  Table "
+              << TableNameToString(stmt->schema, stmt->name)
+              << " did not exist!\r\n";
+    return true;
+  }
+
+  return false;
+}
+
 Table* Parser::getTable(TableRef* table_ref) {
   if (table_ref->type != kTableName) {
     std::cout << "[LiteDB-Error]  Only support ordinary table.\r\n";
@@ -258,6 +572,8 @@ bool Parser::checkValues(std::vector<ColumnDefinition*>* columns,
   for (size_t i = 0; i < columns->size(); i++) {
     auto col_def = (*columns)[i];
     auto expr = (*values)[i];
+    // NULL 可以插入任意类型的列
+    if (expr->type == kExprLiteralNull) continue;
 
     switch (col_def->type.data_type) {
       case DataType::INT:
@@ -313,8 +629,12 @@ bool Parser::checkCreateStmt(const CreateStatement* stmt) {
     case kCreateTable:
       if (checkCreateTableStmt(stmt)) return true;
       break;
+    case kCreateIndex:
+      if (checkCreateIndexStmt(stmt)) return true;
+      break;
     default:
-      std::cout << "[LiteDB-Error]  Only support 'Create Table'.\r\n";
+      std::cout << "[LiteDB-Error]  Only support 'Create Table' and 'Create "
+                   "Index'.\r\n";
       return true;
   }
 
@@ -363,17 +683,23 @@ bool Parser::checkCreateTableStmt(const CreateStatement* stmt) {
 }
 
 bool Parser::checkCreateIndexStmt(const CreateStatement* stmt) {
-  if (g_meta_data.getIndex(stmt->schema, stmt->tableName, stmt->indexName) !=
-          nullptr &&
-      !stmt->ifNotExists) {
-    std::cout << "[LiteDB-Error]  Index " << stmt->indexName << "of "
+  Table* table = g_meta_data.getTable(stmt->schema, stmt->tableName);
+  if (table == nullptr) {
+    std::cout << "[LiteDB-Error]  Table "
               << TableNameToString(stmt->schema, stmt->tableName)
+              << " did not exist!\r\n";
+    return true;
+  }
+
+  // 索引名在所有表中唯一
+  if (g_meta_data.getIndex(stmt->indexName) != nullptr && !stmt->ifNotExists) {
+    std::cout << "[LiteDB-Error]  Index " << stmt->indexName
               << " already existed!\r\n";
     return true;
   }
 
   // 检查 index 每一列是否存在
-  Table* table = g_meta_data.getTable(stmt->schema, stmt->tableName);
+  if (stmt->indexColumns == nullptr) return true;
   for (auto idx_col : *stmt->indexColumns)
     if (checkColumn(table, idx_col)) return true;
 
@@ -401,11 +727,9 @@ bool Parser::checkDropStmt(const DropStatement* stmt) {
       break;
     }
     case kDropIndex: {
-      if (g_meta_data.getIndex(stmt->schema, stmt->name, stmt->indexName) ==
-              nullptr &&
+      if (g_meta_data.getIndex(stmt->indexName) == nullptr &&
           !stmt->ifExists) {
-        std::cout << "[LiteDB-Error]  Index " << stmt->indexName << " of "
-                  << TableNameToString(stmt->schema, stmt->name)
+        std::cout << "[LiteDB-Error]  Index " << stmt->indexName
                   << " did not exist!\r\n";
         return true;
       }
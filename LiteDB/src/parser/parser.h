@@ -7,6 +7,65 @@
 using namespace hsql;
 
 namespace litedb {
+
+// 多行 INSERT 语句。hsql 只支持单行 VALUES，Parser 把多行 VALUES 拆成多条
+// 单行 INSERT 解析，再把每一行的值合并到 rows 中，values 置为 nullptr。
+struct InsertRowsStatement : public InsertStatement {
+  InsertRowsStatement() : InsertStatement(kInsertValues) {}
+  ~InsertRowsStatement() override {
+    for (auto row : rows) {
+      for (auto expr : *row) delete expr;
+      delete row;
+    }
+  }
+
+  std::vector<std::vector<Expr*>*> rows;
+};
+
+// CREATE INDEX 语句，Parser 自己识别，index_type 由 USING 子句指定
+struct CreateIndexStatement : public CreateStatement {
+  CreateIndexStatement()
+      : CreateStatement(kCreateIndex), index_type(kBTreeIndex) {}
+
+  IndexType index_type;
+};
+
+// hsql 不支持的维护命令，Parser 在调用 hsql 之前按文本识别。语句类型借用
+// hsql 中没有使用的 kStmtError。
+const StatementType kStmtUtility = kStmtError;
+
+enum UtilityType {
+  kUtilityCheckpoint,
+  kUtilityVacuum,
+  kUtilityAnalyze,
+  kUtilityTruncate
+};
+
+// SHOW TABLE STATUS [schema.table] 和 SHOW STATS schema.table，同样在调用
+// hsql 之前识别，生成 ShowStatement，type 借用 hsql 的 ShowType 之后的值
+const ShowType kShowTableStatus = static_cast<ShowType>(kShowTables + 1);
+const ShowType kShowStats = static_cast<ShowType>(kShowTables + 2);
+
+// VACUUM 和 ANALYZE 可以指定一张表，schema 和 name 为 nullptr 时作用于所有
+// 的表。VACUUM FREEZE 还会压缩写满的 tuple group。TRUNCATE 必须指定一张表
+struct UtilityStatement : public SQLStatement {
+  explicit UtilityStatement(UtilityType t)
+      : SQLStatement(kStmtUtility),
+        type(t),
+        freeze(false),
+        schema(nullptr),
+        name(nullptr) {}
+  ~UtilityStatement() override {
+    free(schema);
+    free(name);
+  }
+
+  UtilityType type;
+  bool freeze;
+  char* schema;
+  char* name;
+};
+
 class Parser {
  public:
   Parser();
@@ -17,13 +76,22 @@ class Parser {
   SQLParserResult* getResult() { return result_; }
 
  private:
+  std::string splitInsertRows(const std::string& query,
+                              std::vector<size_t>* row_cnts);
+
+  void mergeInsertRows(const std::vector<size_t>& row_cnts);
+
+  bool parseUtilityStatement(const std::string& query);
+
+  CreateStatement* parseCreateIndex(const std::string& query);
+
   bool checkStmtsMeta();
 
   bool checkMeta(const SQLStatement* stmt);
 
   bool checkSelectStmt(const SelectStatement* stmt);
 
-  bool checkInsertStmt(const InsertStatement* stmt);
+  bool checkInsertStmt(const InsertRowsStatement* stmt);
 
   bool checkUpdateStmt(const UpdateStatement* stmt);
 
@@ -33,6 +101,8 @@ class Parser {
 
   bool checkDropStmt(const DropStatement* stmt);
 
+  bool checkUtilityStmt(const UtilityStatement* stmt);
+
   bool checkCreateIndexStmt(const CreateStatement* stmt);
 
   bool checkCreateTableStmt(const CreateStatement* stmt);
@@ -43,6 +113,9 @@ class Parser {
 
   bool checkExpr(Table* table, Expr* expr);
 
+  bool checkInsertRow(Table* table, const InsertRowsStatement* stmt,
+                      std::vector<Expr*>* row);
+
   bool checkValues(std::vector<ColumnDefinition*>* columns,
                    std::vector<Expr*>* values);
 
@@ -0,0 +1,333 @@
+#include "btree.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace litedb {
+
+#define BTREE_MIN_KEYS (BTREE_NODE_KEYS / 2)
+
+// 内部节点的 children 比 keys 多一个，keys[i] 不大于 children[i + 1] 的
+// 子树中所有的键，并且大于 children[i] 的子树中所有的键
+struct BPlusTree::Node {
+  bool leaf;
+  std::vector<std::string> keys;
+  std::vector<uint64_t> values;
+  std::vector<Node*> children;
+  Node* next;
+};
+
+const std::string& BPlusTree::Iterator::key() const {
+  return leaf_->keys[pos_];
+}
+
+uint64_t BPlusTree::Iterator::value() const { return leaf_->values[pos_]; }
+
+void BPlusTree::Iterator::next() {
+  if (++pos_ < leaf_->keys.size()) return;
+
+  // 只有根节点可能是空的叶子节点
+  leaf_ = leaf_->next;
+  pos_ = 0;
+}
+
+BPlusTree::BPlusTree() : size_(0), node_cnt_(0), key_bytes_(0) {
+  root_ = newNode(true);
+}
+
+BPlusTree::~BPlusTree() { freeNode(root_); }
+
+BPlusTree::Node* BPlusTree::newNode(bool leaf) {
+  Node* node = new Node();
+  node->leaf = leaf;
+  node->next = nullptr;
+  node_cnt_++;
+  return node;
+}
+
+void BPlusTree::freeNode(Node* node) {
+  for (auto child : node->children) freeNode(child);
+  delete node;
+}
+
+void BPlusTree::clear() {
+  freeNode(root_);
+  size_ = 0;
+  node_cnt_ = 0;
+  key_bytes_ = 0;
+  root_ = newNode(true);
+}
+
+size_t BPlusTree::memoryBytes() const {
+  return node_cnt_ * sizeof(Node) +
+         size_ * (sizeof(std::string) + sizeof(uint64_t)) + key_bytes_ +
+         (node_cnt_ - 1) * (sizeof(std::string) + sizeof(Node*));
+}
+
+// 把 cnt 项分到若干个节点，每个节点大约 target 项，并且在 [min, max] 之间。
+// 只有一个节点时不限制最少的项数
+static size_t NodeCount(size_t cnt, size_t target, size_t min, size_t max) {
+  size_t nodes = std::min((cnt + target - 1) / target, cnt / min);
+  nodes = std::max(nodes, (cnt + max - 1) / max);
+  return std::max<size_t>(nodes, 1);
+}
+
+void BPlusTree::bulkLoad(std::vector<std::pair<std::string, uint64_t>>* entries,
+                         int fill_factor) {
+  clear();
+  if (entries->empty()) return;
+
+  fill_factor = std::min(std::max(fill_factor, 50), 100);
+  size_t target = std::max<size_t>(BTREE_NODE_KEYS * fill_factor / 100,
+                                   BTREE_MIN_KEYS);
+
+  // 叶子层，low_keys 是每个节点的子树中最小的键
+  std::vector<Node*> level;
+  std::vector<std::string> low_keys;
+  size_t cnt = entries->size();
+  size_t nodes = NodeCount(cnt, target, BTREE_MIN_KEYS, BTREE_NODE_KEYS);
+  Node* prev = nullptr;
+  for (size_t i = 0; i < nodes; i++) {
+    Node* leaf = (i == 0) ? root_ : newNode(true);
+    for (size_t j = i * cnt / nodes; j < (i + 1) * cnt / nodes; j++) {
+      key_bytes_ += (*entries)[j].first.size();
+      leaf->keys.emplace_back(std::move((*entries)[j].first));
+      leaf->values.emplace_back((*entries)[j].second);
+    }
+    if (prev != nullptr) prev->next = leaf;
+    prev = leaf;
+    low_keys.emplace_back(leaf->keys.front());
+    level.emplace_back(leaf);
+  }
+  size_ = cnt;
+  entries->clear();
+
+  // 逐层向上构建内部节点，除第一个子节点之外每个子节点的最小键作为分隔键
+  while (level.size() > 1) {
+    cnt = level.size();
+    nodes = NodeCount(cnt, target + 1, BTREE_MIN_KEYS + 1, BTREE_NODE_KEYS + 1);
+    std::vector<Node*> parents;
+    std::vector<std::string> parent_low_keys;
+    for (size_t i = 0; i < nodes; i++) {
+      Node* node = newNode(false);
+      size_t begin = i * cnt / nodes;
+      for (size_t j = begin; j < (i + 1) * cnt / nodes; j++) {
+        if (j > begin) node->keys.emplace_back(std::move(low_keys[j]));
+        node->children.emplace_back(level[j]);
+      }
+      parents.emplace_back(node);
+      parent_low_keys.emplace_back(std::move(low_keys[begin]));
+    }
+    level.swap(parents);
+    low_keys.swap(parent_low_keys);
+  }
+  root_ = level.front();
+}
+
+bool BPlusTree::insert(const std::string& key, uint64_t value) {
+  std::string split_key;
+  Node* split = nullptr;
+  if (insertInto(root_, key, value, &split_key, &split)) return true;
+
+  size_++;
+  key_bytes_ += key.size();
+  if (split != nullptr) {
+    Node* root = newNode(false);
+    root->keys.emplace_back(split_key);
+    root->children.emplace_back(root_);
+    root->children.emplace_back(split);
+    root_ = root;
+  }
+  return false;
+}
+
+bool BPlusTree::insertInto(Node* node, const std::string& key, uint64_t value,
+                           std::string* split_key, Node** split) {
+  if (node->leaf) {
+    size_t pos = std::lower_bound(node->keys.begin(), node->keys.end(), key) -
+                 node->keys.begin();
+    if (pos < node->keys.size() && node->keys[pos] == key) return true;
+    node->keys.insert(node->keys.begin() + pos, key);
+    node->values.insert(node->values.begin() + pos, value);
+    if (node->keys.size() <= BTREE_NODE_KEYS) return false;
+
+    // 后一半移到新的右兄弟
+    size_t mid = node->keys.size() / 2;
+    Node* right = newNode(true);
+    right->keys.assign(node->keys.begin() + mid, node->keys.end());
+    right->values.assign(node->values.begin() + mid, node->values.end());
+    node->keys.resize(mid);
+    node->values.resize(mid);
+    right->next = node->next;
+    node->next = right;
+    *split_key = right->keys.front();
+    *split = right;
+    return false;
+  }
+
+  size_t i = std::upper_bound(node->keys.begin(), node->keys.end(), key) -
+             node->keys.begin();
+  std::string child_key;
+  Node* child_split = nullptr;
+  if (insertInto(node->children[i], key, value, &child_key, &child_split))
+    return true;
+  if (child_split == nullptr) return false;
+
+  node->keys.insert(node->keys.begin() + i, child_key);
+  node->children.insert(node->children.begin() + i + 1, child_split);
+  if (node->keys.size() <= BTREE_NODE_KEYS) return false;
+
+  // 中间的键上移到父节点
+  size_t mid = node->keys.size() / 2;
+  Node* right = newNode(false);
+  *split_key = node->keys[mid];
+  right->keys.assign(node->keys.begin() + mid + 1, node->keys.end());
+  right->children.assign(node->children.begin() + mid + 1,
+                         node->children.end());
+  node->keys.resize(mid);
+  node->children.resize(mid + 1);
+  *split = right;
+  return false;
+}
+
+bool BPlusTree::remove(const std::string& key) {
+  if (removeFrom(root_, key)) return true;
+
+  size_--;
+  key_bytes_ -= key.size();
+  // 根节点只剩一个子节点时树的高度减一
+  if (!root_->leaf && root_->keys.empty()) {
+    Node* root = root_->children[0];
+    root_->children.clear();
+    freeNode(root_);
+    node_cnt_--;
+    root_ = root;
+  }
+  return false;
+}
+
+bool BPlusTree::removeFrom(Node* node, const std::string& key) {
+  if (node->leaf) {
+    size_t pos = std::lower_bound(node->keys.begin(), node->keys.end(), key) -
+                 node->keys.begin();
+    if (pos == node->keys.size() || node->keys[pos] != key) return true;
+    node->keys.erase(node->keys.begin() + pos);
+    node->values.erase(node->values.begin() + pos);
+    return false;
+  }
+
+  size_t i = std::upper_bound(node->keys.begin(), node->keys.end(), key) -
+             node->keys.begin();
+  if (removeFrom(node->children[i], key)) return true;
+  if (node->children[i]->keys.size() < BTREE_MIN_KEYS) rebalance(node, i);
+  return false;
+}
+
+void BPlusTree::rebalance(Node* node, size_t i) {
+  Node* child = node->children[i];
+  Node* left = (i > 0) ? node->children[i - 1] : nullptr;
+  Node* right =
+      (i + 1 < node->children.size()) ? node->children[i + 1] : nullptr;
+
+  if (left != nullptr && left->keys.size() > BTREE_MIN_KEYS) {
+    if (child->leaf) {
+      child->keys.insert(child->keys.begin(), left->keys.back());
+      child->values.insert(child->values.begin(), left->values.back());
+      left->values.pop_back();
+      node->keys[i - 1] = child->keys.front();
+    } else {
+      child->keys.insert(child->keys.begin(), node->keys[i - 1]);
+      child->children.insert(child->children.begin(), left->children.back());
+      left->children.pop_back();
+      node->keys[i - 1] = left->keys.back();
+    }
+    left->keys.pop_back();
+  } else if (right != nullptr && right->keys.size() > BTREE_MIN_KEYS) {
+    if (child->leaf) {
+      child->keys.emplace_back(right->keys.front());
+      child->values.emplace_back(right->values.front());
+      right->keys.erase(right->keys.begin());
+      right->values.erase(right->values.begin());
+      node->keys[i] = right->keys.front();
+    } else {
+      child->keys.emplace_back(node->keys[i]);
+      child->children.emplace_back(right->children.front());
+      node->keys[i] = right->keys.front();
+      right->keys.erase(right->keys.begin());
+      right->children.erase(right->children.begin());
+    }
+  } else if (left != nullptr) {
+    mergeChildren(node, i - 1);
+  } else if (right != nullptr) {
+    mergeChildren(node, i);
+  }
+}
+
+void BPlusTree::mergeChildren(Node* node, size_t i) {
+  Node* left = node->children[i];
+  Node* right = node->children[i + 1];
+  if (left->leaf) {
+    left->next = right->next;
+  } else {
+    left->keys.emplace_back(node->keys[i]);
+    left->children.insert(left->children.end(), right->children.begin(),
+                          right->children.end());
+    right->children.clear();
+  }
+  left->keys.insert(left->keys.end(), right->keys.begin(), right->keys.end());
+  left->values.insert(left->values.end(), right->values.begin(),
+                      right->values.end());
+
+  freeNode(right);
+  node_cnt_--;
+  node->keys.erase(node->keys.begin() + i);
+  node->children.erase(node->children.begin() + i + 1);
+}
+
+BPlusTree::Iterator BPlusTree::lowerBound(const std::string& key) const {
+  Node* node = root_;
+  while (!node->leaf) {
+    size_t i = std::upper_bound(node->keys.begin(), node->keys.end(), key) -
+               node->keys.begin();
+    node = node->children[i];
+  }
+
+  size_t pos = std::lower_bound(node->keys.begin(), node->keys.end(), key) -
+               node->keys.begin();
+  if (pos < node->keys.size()) return Iterator(node, pos);
+  return Iterator(node->next, 0);
+}
+
+void EncodeKeyNull(std::string* key) { key->push_back('\0'); }
+
+void EncodeKeyUint64(uint64_t val, std::string* key) {
+  for (int shift = 56; shift >= 0; shift -= 8)
+    key->push_back(static_cast<char>((val >> shift) & 0xff));
+}
+
+// 翻转符号位之后按无符号数比较
+void EncodeKeyInt(int64_t val, std::string* key) {
+  key->push_back('\1');
+  EncodeKeyUint64(static_cast<uint64_t>(val) ^ (1ULL << 63), key);
+}
+
+// 正数翻转符号位，负数翻转所有位。-0.0 和 0.0 编码相同
+void EncodeKeyDouble(double val, std::string* key) {
+  if (val == 0) val = 0;
+  uint64_t bits;
+  memcpy(&bits, &val, sizeof(bits));
+  bits = (bits & (1ULL << 63)) ? ~bits : bits ^ (1ULL << 63);
+  key->push_back('\1');
+  EncodeKeyUint64(bits, key);
+}
+
+void EncodeKeyString(const char* str, size_t len, std::string* key) {
+  key->push_back('\1');
+  for (size_t i = 0; i < len; i++) {
+    key->push_back(str[i]);
+    if (str[i] == '\0') key->push_back('\xff');
+  }
+  key->append(2, '\0');
+}
+
+}  // namespace litedb
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace litedb {
+
+// B+ 树节点最多的键数，除根节点之外的节点至少有一半
+#define BTREE_NODE_KEYS 64
+
+// 内存中的 B+ 树，键是按字节比较的字符串，值是 uint64_t，键不能重复。叶子
+// 节点按键的顺序串成链表，用于范围扫描。
+class BPlusTree {
+ public:
+  struct Node;
+
+  // 指向叶子节点中的一个键，树被修改之后失效
+  class Iterator {
+   public:
+    explicit Iterator(Node* leaf = nullptr, size_t pos = 0)
+        : leaf_(leaf), pos_(pos) {}
+
+    bool valid() const { return leaf_ != nullptr; }
+    const std::string& key() const;
+    uint64_t value() const;
+    void next();
+
+   private:
+    Node* leaf_;
+    size_t pos_;
+  };
+
+  BPlusTree();
+  ~BPlusTree();
+
+  // 键已经存在时返回 true
+  bool insert(const std::string& key, uint64_t value);
+  // 键不存在时返回 true
+  bool remove(const std::string& key);
+  // 第一个不小于 key 的键
+  Iterator lowerBound(const std::string& key) const;
+  Iterator begin() const { return lowerBound(std::string()); }
+  void clear();
+  // 用按键严格递增的 entries 替换树中所有的项，自底向上逐层构建。除每层
+  // 最后的调整之外，节点填充 fill_factor% 的键，取值 50 到 100。完成之后
+  // entries 被清空
+  void bulkLoad(std::vector<std::pair<std::string, uint64_t>>* entries,
+                int fill_factor);
+
+  size_t size() const { return size_; }
+  // 叶子节点和内部节点的总数
+  size_t nodeCount() const { return node_cnt_; }
+  // 节点和键占用的内存，不计 std::string 内部的对齐和预留空间
+  size_t memoryBytes() const;
+
+ private:
+  // node 的子树中插入，node 分裂时通过 split_key 和 split 返回新的右兄弟
+  bool insertInto(Node* node, const std::string& key, uint64_t value,
+                  std::string* split_key, Node** split);
+  bool removeFrom(Node* node, const std::string& key);
+  // node 的第 i 个子节点的键少于一半时，从兄弟节点借一个键或者与兄弟合并
+  void rebalance(Node* node, size_t i);
+  // 把 node 的第 i + 1 个子节点合并到第 i 个子节点
+  void mergeChildren(Node* node, size_t i);
+  Node* newNode(bool leaf);
+  void freeNode(Node* node);
+
+  Node* root_;
+  size_t size_;
+  size_t node_cnt_;
+  size_t key_bytes_;
+};
+
+// 索引键的编码。各列的值依次追加，编码之后按字节比较的顺序和值的顺序相同。
+// NULL 编码为 0x00，小于所有不为 NULL 的值，其他值都以 0x01 开头。
+void EncodeKeyNull(std::string* key);
+void EncodeKeyInt(int64_t val, std::string* key);
+void EncodeKeyDouble(double val, std::string* key);
+// 字符串中的 0x00 转义为 0x00 0xff，最后以 0x00 0x00 结束，保证前缀更短的
+// 字符串更小
+void EncodeKeyString(const char* str, size_t len, std::string* key);
+void EncodeKeyUint64(uint64_t val, std::string* key);
+
+}  // namespace litedb
\ No newline at end of file
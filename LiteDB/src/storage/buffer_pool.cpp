@@ -0,0 +1,290 @@
+#include "buffer_pool.h"
+
+#include <sys/mman.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include "storage/wal.h"
+
+namespace litedb {
+
+BufferPool g_buffer_pool;
+bool g_huge_pages = false;
+
+BufferPool::~BufferPool() {
+  if (arena_ != nullptr) munmap(arena_, arena_size_);
+}
+
+bool BufferPool::init(size_t size) {
+  size_t frame_cnt = size / PAGE_SIZE;
+  if (frame_cnt < BUFFER_POOL_MIN_FRAMES) frame_cnt = BUFFER_POOL_MIN_FRAMES;
+
+  // 所有页帧在一块连续的内存中，按大页映射可以减少扫描大表时的 TLB
+  // miss。没有预留大页时退回普通映射，没有访问过的页帧不会占用物理内存
+  arena_size_ = (frame_cnt * PAGE_SIZE + HUGE_PAGE_SIZE - 1) &
+                ~static_cast<size_t>(HUGE_PAGE_SIZE - 1);
+  void* addr = MAP_FAILED;
+  if (g_huge_pages) {
+    addr = mmap(nullptr, arena_size_, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (addr == MAP_FAILED)
+      std::cout << "[LiteDB-Info]  Huge pages are not available: "
+                << strerror(errno) << "\r\n";
+  }
+  if (addr == MAP_FAILED) {
+    // 多映射一个大页，截掉首尾使内存按大页对齐，透明大页才能覆盖整个区域
+    size_t len = arena_size_ + HUGE_PAGE_SIZE;
+    addr = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+      std::cout << "[LiteDB-Error]  Failed to map " << len
+                << " bytes for buffer pool: " << strerror(errno) << "\r\n";
+      return true;
+    }
+    char* begin = static_cast<char*>(addr);
+    char* aligned = reinterpret_cast<char*>(
+        (reinterpret_cast<uintptr_t>(begin) + HUGE_PAGE_SIZE - 1) &
+        ~static_cast<uintptr_t>(HUGE_PAGE_SIZE - 1));
+    if (aligned > begin) munmap(begin, aligned - begin);
+    munmap(aligned + arena_size_, begin + len - aligned - arena_size_);
+    addr = aligned;
+    madvise(addr, arena_size_, MADV_HUGEPAGE);
+  }
+  arena_ = static_cast<char*>(addr);
+
+  frames_.resize(frame_cnt);
+  for (size_t i = 0; i < frame_cnt; i++) {
+    frames_[i] = {nullptr, 0, 0, 0, false, 0, arena_ + i * PAGE_SIZE};
+    free_frames_.emplace_back(frame_cnt - 1 - i);
+  }
+  page_table_.reserve(frame_cnt);
+
+  return false;
+}
+
+Frame* BufferPool::fetchPage(DiskFile* file, uint32_t page_no,
+                             bool sequential) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Frame* frame = lookup(file, page_no);
+  if (frame != nullptr) {
+    if (!sequential && frame->usage < BUFFER_POOL_MAX_USAGE) frame->usage++;
+    frame->pin_cnt++;
+    return frame;
+  }
+
+  frame = allocFrame(file, page_no);
+  if (frame == nullptr) return nullptr;
+
+  if (file->readPage(page_no, frame->data)) {
+    freeFrame(frame);
+    return nullptr;
+  }
+  frame->usage = sequential ? 0 : 1;
+  return frame;
+}
+
+Frame* BufferPool::newPage(DiskFile* file, uint32_t page_no) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Frame* frame = lookup(file, page_no);
+  if (frame == nullptr) {
+    frame = allocFrame(file, page_no);
+    if (frame == nullptr) return nullptr;
+    frame->usage = 1;
+  } else {
+    frame->pin_cnt++;
+  }
+
+  memset(frame->data, 0, PAGE_SIZE);
+  if (!frame->dirty) frame->rec_lsn = g_wal.nextLsn();
+  frame->dirty = true;
+  return frame;
+}
+
+void BufferPool::unpinPage(Frame* frame) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  frame->pin_cnt--;
+}
+
+bool BufferPool::contains(DiskFile* file, uint32_t page_no) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return lookup(file, page_no) != nullptr;
+}
+
+size_t BufferPool::residentPages(DiskFile* file) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t cnt = 0;
+  for (auto& frame : frames_)
+    if (frame.file == file) cnt++;
+  return cnt;
+}
+
+void BufferPool::markDirty(Frame* frame) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!frame->dirty) frame->rec_lsn = g_wal.nextLsn();
+  frame->dirty = true;
+}
+
+bool BufferPool::isDirty(Frame* frame) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return frame->dirty;
+}
+
+bool BufferPool::flushPage(DiskFile* file, uint32_t page_no) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Frame* frame = lookup(file, page_no);
+  if (frame == nullptr || !frame->dirty) return false;
+
+  return writeFrame(frame);
+}
+
+// 检查点线程正在写回的页要等写完再丢弃，否则旧的内容可能在之后才写入文件
+void BufferPool::discardPage(DiskFile* file, uint32_t page_no) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  Frame* frame = lookup(file, page_no);
+  if (frame == nullptr) return;
+
+  idle_cv_.wait(lock, [frame] { return frame->pin_cnt == 0; });
+  freeFrame(frame);
+}
+
+void BufferPool::dropFile(DiskFile* file) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_cv_.wait(lock, [this, file] { return file_refs_.count(file) == 0; });
+  for (auto& frame : frames_)
+    if (frame.file == file) freeFrame(&frame);
+  unsynced_files_.erase(file);
+}
+
+bool BufferPool::checkpoint(uint64_t* min_rec_lsn) {
+  std::vector<char> copy(PAGE_SIZE);
+  std::vector<DiskFile*> files;
+  bool err = false;
+
+  for (size_t i = 0; i < frames_.size() && !err; i++) {
+    Frame* frame = &frames_[i];
+    uint64_t rec_lsn;
+    {
+      // 拷贝时页没有被 pin 住，不会有线程同时修改。写回期间 pin 住页帧，
+      // 防止页被淘汰后又从文件中读到旧的内容
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (frame->file == nullptr || !frame->dirty || frame->pin_cnt > 0)
+        continue;
+      memcpy(copy.data(), frame->data, PAGE_SIZE);
+      frame->dirty = false;
+      frame->pin_cnt++;
+      rec_lsn = frame->rec_lsn;
+      // 写完一页后引用减回 0，但在 sync 之前条目一直保留
+      if (file_refs_.count(frame->file) == 0) files.emplace_back(frame->file);
+      file_refs_[frame->file]++;
+    }
+
+    err = g_wal.flushTo(PageLsn(copy.data())) ||
+          frame->file->writePage(frame->page_no, copy.data());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (err) {
+      // 没有写回的修改仍然需要从 rec_lsn 开始的日志
+      if (!frame->dirty || rec_lsn < frame->rec_lsn) frame->rec_lsn = rec_lsn;
+      frame->dirty = true;
+    }
+    frame->pin_cnt--;
+    file_refs_[frame->file]--;
+    idle_cv_.notify_all();
+  }
+
+  // 之后写回的页在写回前是脏页，rec_lsn 已经计入 min_rec_lsn
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    *min_rec_lsn = UINT64_MAX;
+    for (auto& frame : frames_)
+      if (frame.file != nullptr && frame.dirty && frame.rec_lsn < *min_rec_lsn)
+        *min_rec_lsn = frame.rec_lsn;
+    for (auto file : unsynced_files_)
+      if (file_refs_.emplace(file, 0).second) files.emplace_back(file);
+    unsynced_files_.clear();
+  }
+
+  for (auto file : files) {
+    if (!err) err = file->sync();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (err) unsynced_files_.emplace(file);
+    file_refs_.erase(file);
+    idle_cv_.notify_all();
+  }
+
+  return err;
+}
+
+Frame* BufferPool::lookup(DiskFile* file, uint32_t page_no) {
+  auto iter = page_table_.find({file, page_no});
+  if (iter == page_table_.end()) return nullptr;
+  return &frames_[iter->second];
+}
+
+// 分配一个 pin 住的页帧，优先使用空闲页帧，否则按 clock 算法淘汰
+Frame* BufferPool::allocFrame(DiskFile* file, uint32_t page_no) {
+  if (frames_.empty() && init(BUFFER_POOL_DEFAULT_SIZE)) return nullptr;
+
+  size_t victim = frames_.size();
+  if (!free_frames_.empty()) {
+    victim = free_frames_.back();
+    free_frames_.pop_back();
+  } else {
+    size_t max_steps = frames_.size() * (BUFFER_POOL_MAX_USAGE + 1);
+    for (size_t i = 0; i < max_steps; i++) {
+      Frame& frame = frames_[hand_];
+      size_t cur = hand_;
+      hand_ = (hand_ + 1) % frames_.size();
+
+      if (frame.pin_cnt > 0) continue;
+      if (frame.usage > 0) {
+        frame.usage--;
+        continue;
+      }
+      if (frame.dirty && writeFrame(&frame)) continue;
+
+      victim = cur;
+      page_table_.erase({frame.file, frame.page_no});
+      break;
+    }
+
+    if (victim == frames_.size()) {
+      std::cout << "[LiteDB-Error]  No free frame in buffer pool, all "
+                << frames_.size() << " frames are pinned.\r\n";
+      return nullptr;
+    }
+  }
+
+  Frame* frame = &frames_[victim];
+  frame->file = file;
+  frame->page_no = page_no;
+  frame->pin_cnt = 1;
+  frame->usage = 0;
+  frame->dirty = false;
+  page_table_.emplace(PageKey{file, page_no}, victim);
+  return frame;
+}
+
+// 写回脏页之前，修改这一页的日志必须已经持久化 (WAL 规则)
+bool BufferPool::writeFrame(Frame* frame) {
+  if (g_wal.flushTo(PageLsn(frame->data)) ||
+      frame->file->writePage(frame->page_no, frame->data))
+    return true;
+  frame->dirty = false;
+  unsynced_files_.emplace(frame->file);
+  return false;
+}
+
+void BufferPool::freeFrame(Frame* frame) {
+  page_table_.erase({frame->file, frame->page_no});
+  frame->file = nullptr;
+  frame->pin_cnt = 0;
+  frame->dirty = false;
+  free_frames_.emplace_back(frame - frames_.data());
+}
+
+}  // namespace litedb
\ No newline at end of file
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "storage/disk.h"
+
+namespace litedb {
+
+// 缓冲池默认大小 128 MB，可以通过 --buffer-pool <MB> 指定
+#define BUFFER_POOL_DEFAULT_SIZE (128 * 1024 * 1024)
+// 缓冲池至少包含的页帧数
+#define BUFFER_POOL_MIN_FRAMES 16
+// 页帧 usage 的上限，clock 最多扫过这么多轮才会淘汰一直被访问的页
+#define BUFFER_POOL_MAX_USAGE 5
+// 大页的大小，页帧所在的内存按大页对齐
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// 缓冲池中的一个页帧，file 为 nullptr 时页帧空闲
+struct Frame {
+  DiskFile* file;
+  uint32_t page_no;
+  int pin_cnt;
+  int usage;
+  bool dirty;
+  // 页从干净变脏时的日志位置，页的修改都记录在这之后的日志中
+  uint64_t rec_lsn;
+  char* data;
+};
+
+// 所有数据文件共享的缓冲池，内存大小在启动时固定。页帧按 clock 算法淘汰：
+// 每次访问增加页帧的 usage，时钟指针扫过时减少，减到 0 且没有被 pin 住的
+// 页帧被淘汰。顺序扫描读入的页 usage 为 0，扫描时命中也不增加 usage，
+// 大表的全表扫描只会在缓冲池中轮转，不会挤掉经常访问的页。
+// 脏页随时可以被淘汰 (steal)，淘汰前先写回，恢复时由日志撤销没有提交的修改。
+// 页帧的元数据由 mutex_ 保护，页的内容只由 pin 住它的线程读写。
+class BufferPool {
+ public:
+  BufferPool() : arena_(nullptr), arena_size_(0), hand_(0) {}
+  ~BufferPool();
+
+  bool init(size_t size);
+
+  // 返回 pin 住的页帧，缓冲池中没有可以淘汰的页帧时返回 nullptr
+  Frame* fetchPage(DiskFile* file, uint32_t page_no, bool sequential = false);
+  // 不读文件，返回内容全为 0 的脏页
+  Frame* newPage(DiskFile* file, uint32_t page_no);
+  void unpinPage(Frame* frame);
+  // 页是否在缓冲池中
+  bool contains(DiskFile* file, uint32_t page_no);
+  // 修改 pin 住的页之前调用
+  void markDirty(Frame* frame);
+  bool isDirty(Frame* frame);
+
+  // 页在缓冲池中且是脏页时写回文件，不会 sync
+  bool flushPage(DiskFile* file, uint32_t page_no);
+  // 丢弃页的修改，之后访问会重新读文件
+  void discardPage(DiskFile* file, uint32_t page_no);
+  // 关闭文件前丢弃它的所有页
+  void dropFile(DiskFile* file);
+
+  // 模糊检查点：写回所有没有被 pin 住的脏页并 sync 对应的文件，淘汰时写回
+  // 的文件也一起 sync，不阻塞其他线程访问缓冲池。min_rec_lsn 返回仍然是
+  // 脏页的最小 rec_lsn，没有脏页时返回 UINT64_MAX
+  bool checkpoint(uint64_t* min_rec_lsn);
+
+  size_t frameCount() { return frames_.size(); }
+  // 缓冲池中属于 file 的页数
+  size_t residentPages(DiskFile* file);
+
+ private:
+  struct PageKey {
+    DiskFile* file;
+    uint32_t page_no;
+    bool operator==(const PageKey& key) const {
+      return file == key.file && page_no == key.page_no;
+    }
+  };
+  struct PageKeyHash {
+    size_t operator()(const PageKey& key) const {
+      return std::hash<DiskFile*>()(key.file) ^ (key.page_no * 0x9e3779b1u);
+    }
+  };
+
+  // 以下函数的调用者持有 mutex_
+  Frame* lookup(DiskFile* file, uint32_t page_no);
+  Frame* allocFrame(DiskFile* file, uint32_t page_no);
+  bool writeFrame(Frame* frame);
+  void freeFrame(Frame* frame);
+
+  std::vector<Frame> frames_;
+  char* arena_;
+  size_t arena_size_;
+  std::vector<size_t> free_frames_;
+  std::unordered_map<PageKey, size_t, PageKeyHash> page_table_;
+  // clock 算法的时钟指针
+  size_t hand_;
+  std::mutex mutex_;
+  // 检查点线程写回页和 sync 文件时增加文件的引用，引用为 0 时才能关闭文件
+  std::unordered_map<DiskFile*, int> file_refs_;
+  // 写回过页但还没有 sync 的文件。写回的页变干净，不再限制日志的截断，
+  // 截断日志之前要 sync，否则崩溃时页可能只写了一部分，日志中却没有它的
+  // 完整内容了
+  std::unordered_set<DiskFile*> unsynced_files_;
+  // 检查点线程释放页帧或文件时通知
+  std::condition_variable idle_cv_;
+};
+
+extern BufferPool g_buffer_pool;
+
+// 使用预留的大页 (MAP_HUGETLB) 作为缓冲池的内存 (--huge-pages)。默认使用
+// 普通的匿名映射并建议内核使用透明大页
+extern bool g_huge_pages;
+
+}  // namespace litedb
\ No newline at end of file
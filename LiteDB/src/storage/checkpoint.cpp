@@ -0,0 +1,70 @@
+#include "checkpoint.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "storage/buffer_pool.h"
+#include "storage/wal.h"
+
+namespace litedb {
+
+int g_checkpoint_interval = 60;
+Checkpointer g_checkpointer;
+
+void Checkpointer::start() {
+  if (thread_.joinable()) return;
+  stop_ = false;
+  thread_ = std::thread(&Checkpointer::loop, this);
+}
+
+void Checkpointer::stop() {
+  if (!thread_.joinable()) return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  thread_.join();
+}
+
+void Checkpointer::request() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    requested_ = true;
+  }
+  cv_.notify_one();
+}
+
+bool Checkpointer::run() {
+  std::lock_guard<std::mutex> lock(run_mutex_);
+
+  // 截断位置不能超过开始时的 LSN：之后才变脏的页的 rec_lsn 都不小于它，
+  // 之后开始的事务的记录也都在它之后
+  uint64_t redo_lsn = g_wal.activeTrxLsn();
+  uint64_t min_rec_lsn;
+  if (g_buffer_pool.checkpoint(&min_rec_lsn) ||
+      g_wal.truncate(std::min(redo_lsn, min_rec_lsn)))
+    return true;
+
+  completed_++;
+  return false;
+}
+
+void Checkpointer::loop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    auto ready = [this] { return stop_ || requested_; };
+    if (g_checkpoint_interval > 0)
+      cv_.wait_for(lock, std::chrono::seconds(g_checkpoint_interval), ready);
+    else
+      cv_.wait(lock, ready);
+    if (stop_) return;
+
+    requested_ = false;
+    lock.unlock();
+    if (g_wal.size() > 0) run();
+    lock.lock();
+  }
+}
+
+}  // namespace litedb
\ No newline at end of file
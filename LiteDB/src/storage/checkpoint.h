@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+namespace litedb {
+
+// 后台检查点的间隔，单位是秒，可以通过 --checkpoint-interval <秒> 指定。
+// 为 0 时只在日志超过 WAL_CHECKPOINT_SIZE 时做检查点
+extern int g_checkpoint_interval;
+
+// 模糊检查点：写回缓冲池中的脏页，然后截断日志。检查点不等待语句或事务
+// 结束，写回期间其他线程照常读写缓冲池。日志只保留最早的脏页的 rec_lsn
+// 和当前事务的第一条记录之后的部分，恢复时只需要重放这一段。
+// catalog 在每次 DDL 时已经写入文件，不需要在检查点中处理。
+class Checkpointer {
+ public:
+  Checkpointer() : requested_(false), stop_(false), completed_(0) {}
+  ~Checkpointer() { stop(); }
+
+  // 启动后台检查点线程，在数据加载和恢复完成之后调用
+  void start();
+  void stop();
+  // 唤醒后台线程做一次检查点，不等待检查点完成
+  void request();
+  // 在当前线程做一次检查点
+  bool run();
+  // 已经完成的检查点个数
+  uint64_t completed() { return completed_; }
+
+ private:
+  void loop();
+
+  // 同一时间只做一个检查点
+  std::mutex run_mutex_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool requested_;
+  bool stop_;
+  std::atomic<uint64_t> completed_;
+  std::thread thread_;
+};
+
+extern Checkpointer g_checkpointer;
+
+}  // namespace litedb
\ No newline at end of file
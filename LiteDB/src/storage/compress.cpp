@@ -0,0 +1,111 @@
+#include "compress.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace litedb {
+
+// 保存 cnt 个 width 位的值需要的字节数，按 uint64_t 对齐
+static size_t PackedSize(size_t cnt, int width) {
+  return (cnt * width + 63) / 64 * 8;
+}
+
+// 保存 cnt 个段的结束槽位需要的字节数，按 8 字节对齐
+static size_t RunEndsSize(size_t cnt) {
+  return (cnt * sizeof(uint16_t) + 7) & ~static_cast<size_t>(7);
+}
+
+static int BitWidth(uint64_t range) {
+  int width = 0;
+  while (width < 64 && (range >> width) != 0) width++;
+  return width;
+}
+
+static void PackValues(const int64_t* values, size_t cnt, int64_t base,
+                       int width, char* out) {
+  memset(out, 0, PackedSize(cnt, width));
+  if (width == 0) return;
+
+  uint64_t* words = reinterpret_cast<uint64_t*>(out);
+  for (size_t i = 0; i < cnt; i++) {
+    uint64_t val = static_cast<uint64_t>(values[i]) - base;
+    size_t bit = i * width;
+    words[bit / 64] |= val << (bit % 64);
+    if (bit % 64 + width > 64) words[bit / 64 + 1] |= val >> (64 - bit % 64);
+  }
+}
+
+static int64_t UnpackValue(const char* data, int64_t base, int width,
+                           size_t i) {
+  if (width == 0) return base;
+
+  const uint64_t* words = reinterpret_cast<const uint64_t*>(data);
+  size_t bit = i * width;
+  uint64_t val = words[bit / 64] >> (bit % 64);
+  if (bit % 64 + width > 64) val |= words[bit / 64 + 1] << (64 - bit % 64);
+  if (width < 64) val &= (1ULL << width) - 1;
+  return static_cast<int64_t>(val + static_cast<uint64_t>(base));
+}
+
+size_t ChooseEncoding(const int64_t* values, size_t cnt, size_t plain_size,
+                      EncodedColumn* col) {
+  col->encoding = kPlainEncoding;
+  col->width = 0;
+  col->run_cnt = 0;
+  col->reserved = 0;
+  col->base = 0;
+  if (cnt == 0) return plain_size;
+
+  int64_t min = values[0], max = values[0];
+  size_t run_cnt = 1;
+  for (size_t i = 1; i < cnt; i++) {
+    min = std::min(min, values[i]);
+    max = std::max(max, values[i]);
+    if (values[i] != values[i - 1]) run_cnt++;
+  }
+
+  // 所有段的值的范围和所有值相同
+  int width = BitWidth(static_cast<uint64_t>(max) - static_cast<uint64_t>(min));
+  size_t packed = PackedSize(cnt, width);
+  size_t rle = RunEndsSize(run_cnt) + PackedSize(run_cnt, width);
+  size_t best = std::min(packed, rle);
+  if (best >= plain_size) return plain_size;
+
+  col->encoding = (rle < packed) ? kRleEncoding : kBitPackEncoding;
+  col->width = width;
+  col->run_cnt = (rle < packed) ? run_cnt : 0;
+  col->base = min;
+  return best;
+}
+
+void EncodeValues(const int64_t* values, size_t cnt, const EncodedColumn& col,
+                  char* out) {
+  if (col.encoding == kBitPackEncoding) {
+    PackValues(values, cnt, col.base, col.width, out);
+    return;
+  }
+
+  std::vector<int64_t> run_values;
+  uint16_t* ends = reinterpret_cast<uint16_t*>(out);
+  memset(out, 0, RunEndsSize(col.run_cnt));
+  for (size_t i = 0; i < cnt; i++) {
+    if (i + 1 < cnt && values[i + 1] == values[i]) continue;
+    ends[run_values.size()] = i + 1;
+    run_values.emplace_back(values[i]);
+  }
+  PackValues(run_values.data(), run_values.size(), col.base, col.width,
+             out + RunEndsSize(col.run_cnt));
+}
+
+int64_t DecodeValue(const char* data, const EncodedColumn& col, size_t i) {
+  if (col.encoding == kBitPackEncoding)
+    return UnpackValue(data, col.base, col.width, i);
+
+  // 第一个结束槽位大于 i 的段
+  const uint16_t* ends = reinterpret_cast<const uint16_t*>(data);
+  size_t run = std::upper_bound(ends, ends + col.run_cnt, i) - ends;
+  return UnpackValue(data + RunEndsSize(col.run_cnt), col.base, col.width, run);
+}
+
+}  // namespace litedb
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace litedb {
+
+// 冻结的 tuple group 中 INT/LONG 列的编码。kBitPackEncoding 是 frame of
+// reference 加位压缩：每个值减去 base 之后用 width 位保存。kRleEncoding 把
+// 连续相等的值合并成一段，先保存每段结束的槽位 (uint16_t)，再按位压缩保存
+// 每段的值。两种编码都可以按槽位随机访问。
+enum ColumnEncoding : uint8_t {
+  kPlainEncoding,
+  kBitPackEncoding,
+  kRleEncoding
+};
+
+// 冻结的 tuple group 中一列的描述，offset 是列数据 (NULL 位图和列值) 在
+// 页内行数据中的偏移
+struct EncodedColumn {
+  uint16_t offset;
+  uint8_t encoding;
+  uint8_t width;
+  uint16_t run_cnt;
+  uint16_t reserved;
+  int64_t base;
+};
+
+// 为 cnt 个值选择占用空间最小的编码，填写 col 中除 offset 之外的字段并
+// 返回编码之后的字节数。压缩之后不比 plain_size 小时选择 kPlainEncoding，
+// 返回 plain_size
+size_t ChooseEncoding(const int64_t* values, size_t cnt, size_t plain_size,
+                      EncodedColumn* col);
+// 按 ChooseEncoding 选择的编码写入 out，col 不能是 kPlainEncoding
+void EncodeValues(const int64_t* values, size_t cnt, const EncodedColumn& col,
+                  char* out);
+// 返回第 i 个值
+int64_t DecodeValue(const char* data, const EncodedColumn& col, size_t i);
+
+}  // namespace litedb
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include "dictionary.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace litedb {
+
+Dictionary::~Dictionary() {
+  if (fd_ >= 0) close(fd_);
+}
+
+bool Dictionary::open(const std::string& path, size_t col_num) {
+  fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (fd_ < 0) {
+    std::cout << "[LiteDB-Error]  Failed to open " << path << ": "
+              << strerror(errno) << "\r\n";
+    return true;
+  }
+  path_ = path;
+  columns_.resize(col_num);
+
+  std::string buf;
+  char chunk[65536];
+  ssize_t ret;
+  while ((ret = read(fd_, chunk, sizeof(chunk))) > 0) buf.append(chunk, ret);
+  if (ret < 0) {
+    std::cout << "[LiteDB-Error]  Failed to read " << path_ << ": "
+              << strerror(errno) << "\r\n";
+    return true;
+  }
+
+  size_t pos = 0;
+  while (pos + 2 * sizeof(uint32_t) <= buf.size()) {
+    uint32_t idx, len;
+    memcpy(&idx, buf.data() + pos, sizeof(idx));
+    memcpy(&len, buf.data() + pos + sizeof(idx), sizeof(len));
+    size_t end = pos + 2 * sizeof(uint32_t) + len;
+    if (end > buf.size()) break;
+    if (idx >= col_num) {
+      std::cout << "[LiteDB-Error]  Invalid dictionary " << path_ << "\r\n";
+      return true;
+    }
+
+    Column& column = columns_[idx];
+    column.values.emplace_back(buf, pos + 2 * sizeof(uint32_t), len);
+    column.codes.emplace(column.values.back(), column.values.size() - 1);
+    pos = end;
+  }
+
+  // 截掉崩溃时没有写完的条目
+  size_ = buf.size();
+  return (pos < size_) ? truncate(pos) : false;
+}
+
+bool Dictionary::truncate(size_t size) {
+  if (ftruncate(fd_, size) < 0) {
+    std::cout << "[LiteDB-Error]  Failed to truncate " << path_ << ": "
+              << strerror(errno) << "\r\n";
+    return true;
+  }
+
+  size_ = size;
+  return false;
+}
+
+bool Dictionary::encode(size_t idx, const char* str, uint32_t* code) {
+  if (lookup(idx, str, code)) return false;
+
+  uint32_t len = strlen(str);
+  uint32_t col = idx;
+  std::string entry(reinterpret_cast<char*>(&col), sizeof(col));
+  entry.append(reinterpret_cast<char*>(&len), sizeof(len));
+  entry.append(str, len);
+  if (write(fd_, entry.data(), entry.size()) !=
+      static_cast<ssize_t>(entry.size())) {
+    std::cout << "[LiteDB-Error]  Failed to write " << path_ << ": "
+              << strerror(errno) << "\r\n";
+    // 去掉写了一部分的条目，之后的条目才能接着追加
+    truncate(size_);
+    return true;
+  }
+  size_ += entry.size();
+  dirty_ = true;
+
+  Column& column = columns_[idx];
+  *code = column.values.size();
+  column.values.emplace_back(str, len);
+  column.codes.emplace(column.values.back(), *code);
+  return false;
+}
+
+bool Dictionary::lookup(size_t idx, const char* str, uint32_t* code) {
+  Column& column = columns_[idx];
+  auto iter = column.codes.find(str);
+  if (iter == column.codes.end()) return false;
+
+  *code = iter->second;
+  return true;
+}
+
+bool Dictionary::sync() {
+  if (!dirty_) return false;
+
+  if (fdatasync(fd_) < 0) {
+    std::cout << "[LiteDB-Error]  Failed to sync " << path_ << ": "
+              << strerror(errno) << "\r\n";
+    return true;
+  }
+  dirty_ = false;
+  return false;
+}
+
+}  // namespace litedb
\ No newline at end of file
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace litedb {
+
+// 表中字典编码的 CHAR 列共用的字典文件 <表 id>.dic。文件由条目依次组成，
+// 每个条目是 [列下标 uint32][字符串长度 uint32][字符串]，编码是字符串在
+// 所在列的字典中的序号。字典只追加不删除，回滚的事务添加的条目也保留。
+// 新条目在引用它们的事务提交之前 sync；崩溃时文件末尾不完整的条目被截掉，
+// 丢失的条目只可能被没有提交的行引用，这些行在恢复时已经撤销。
+class Dictionary {
+ public:
+  Dictionary() : fd_(-1), size_(0), dirty_(false) {}
+  ~Dictionary();
+
+  // 读入所有条目，col_num 是表的列数
+  bool open(const std::string& path, size_t col_num);
+  // 返回 str 在第 idx 列的字典中的编码，不存在时添加新条目
+  bool encode(size_t idx, const char* str, uint32_t* code);
+  // str 不在字典中时返回 false
+  bool lookup(size_t idx, const char* str, uint32_t* code);
+  // 返回的字符串在字典关闭之前有效，编码无效时返回空字符串
+  const char* decode(size_t idx, uint32_t code) {
+    Column& column = columns_[idx];
+    return (code < column.values.size()) ? column.values[code].c_str() : "";
+  }
+  // 把新添加的条目持久化
+  bool sync();
+  // 字典文件中所有条目的字节数
+  size_t size() { return size_; }
+
+ private:
+  bool truncate(size_t size);
+
+  struct Column {
+    // deque 追加元素时不会移动已有的字符串
+    std::deque<std::string> values;
+    std::unordered_map<std::string, uint32_t> codes;
+  };
+
+  int fd_;
+  // 文件中完整条目的长度
+  size_t size_;
+  std::string path_;
+  std::vector<Column> columns_;
+  bool dirty_;
+};
+
+}  // namespace litedb
\ No newline at end of file
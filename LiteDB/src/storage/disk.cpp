@@ -0,0 +1,167 @@
+#include "disk.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace litedb {
+
+std::string g_data_dir = "data";
+bool g_use_mmap = false;
+
+std::string DataFilePath(uint32_t id, const char* suffix) {
+  return g_data_dir + "/" + std::to_string(id) + suffix;
+}
+
+bool DiskFile::open(const std::string& path) {
+  fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd_ < 0) {
+    std::cout << "[LiteDB-Error]  Failed to open " << path << ": "
+              << strerror(errno) << "\r\n";
+    return true;
+  }
+
+  struct stat st;
+  if (fstat(fd_, &st) < 0) {
+    std::cout << "[LiteDB-Error]  Failed to stat " << path << ": "
+              << strerror(errno) << "\r\n";
+    close();
+    return true;
+  }
+
+  path_ = path;
+  page_cnt_ = st.st_size / PAGE_SIZE;
+  return false;
+}
+
+void DiskFile::close() {
+  if (map_ != nullptr) munmap(map_, static_cast<size_t>(map_cnt_) * PAGE_SIZE);
+  map_ = nullptr;
+  map_cnt_ = 0;
+  if (fd_ >= 0) ::close(fd_);
+  fd_ = -1;
+}
+
+// 映射整个文件，页在第一次访问时由内核读入，不占用缓冲池
+const char* DiskFile::mappedPage(uint32_t page_no) {
+  if (!map_enabled_) return nullptr;
+
+  if (page_no >= map_cnt_) {
+    uint32_t page_cnt = page_cnt_;
+    if (page_no >= page_cnt) return nullptr;
+
+    size_t len = static_cast<size_t>(page_cnt) * PAGE_SIZE;
+    void* addr;
+    if (map_ == nullptr)
+      addr = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd_, 0);
+    else
+      addr = mremap(map_, static_cast<size_t>(map_cnt_) * PAGE_SIZE, len,
+                    MREMAP_MAYMOVE);
+    if (addr == MAP_FAILED) {
+      std::cout << "[LiteDB-Error]  Failed to map " << path_ << ": "
+                << strerror(errno) << "\r\n";
+      map_enabled_ = false;
+      return nullptr;
+    }
+    map_ = static_cast<char*>(addr);
+    map_cnt_ = page_cnt;
+  }
+
+  return map_ + static_cast<size_t>(page_no) * PAGE_SIZE;
+}
+
+bool DiskFile::readPage(uint32_t page_no, void* buf) {
+  off_t off = static_cast<off_t>(page_no) * PAGE_SIZE;
+  if (pread(fd_, buf, PAGE_SIZE, off) != PAGE_SIZE) {
+    std::cout << "[LiteDB-Error]  Failed to read page " << page_no << " of "
+              << path_ << "\r\n";
+    return true;
+  }
+
+  return false;
+}
+
+// 返回页去掉末尾全为 0 的块之后的长度
+static size_t TrimmedSize(const void* buf) {
+  const char* data = static_cast<const char*>(buf);
+  size_t size = PAGE_SIZE;
+  while (size > 0) {
+    const char* block = data + size - DISK_BLOCK_SIZE;
+    if (block[0] != 0 || memcmp(block, block + 1, DISK_BLOCK_SIZE - 1) != 0)
+      break;
+    size -= DISK_BLOCK_SIZE;
+  }
+  return size;
+}
+
+bool DiskFile::writePage(uint32_t page_no, const void* buf) {
+  off_t off = static_cast<off_t>(page_no) * PAGE_SIZE;
+  // 新的页要写满才能扩展文件；打洞失败时退回整页写入
+  ssize_t size = (page_no < page_cnt_) ? TrimmedSize(buf) : PAGE_SIZE;
+  if (size < PAGE_SIZE &&
+      fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, off + size,
+                PAGE_SIZE - size) < 0)
+    size = PAGE_SIZE;
+  if (size > 0 && pwrite(fd_, buf, size, off) != size) {
+    std::cout << "[LiteDB-Error]  Failed to write page " << page_no << " of "
+              << path_ << "\r\n";
+    return true;
+  }
+
+  uint32_t page_cnt = page_cnt_;
+  while (page_no >= page_cnt &&
+         !page_cnt_.compare_exchange_weak(page_cnt, page_no + 1)) {
+  }
+  return false;
+}
+
+bool DiskFile::punchPage(uint32_t page_no) {
+  off_t off = static_cast<off_t>(page_no) * PAGE_SIZE;
+  if (fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, off,
+                PAGE_SIZE) < 0) {
+    // 文件系统不支持打洞时写入全 0 的页
+    static const char zero_page[PAGE_SIZE] = {0};
+    return writePage(page_no, zero_page);
+  }
+
+  return false;
+}
+
+bool DiskFile::truncate(uint32_t page_cnt) {
+  // 映射中超出文件末尾的部分不能再访问，下次读页时重新映射
+  if (map_ != nullptr) munmap(map_, static_cast<size_t>(map_cnt_) * PAGE_SIZE);
+  map_ = nullptr;
+  map_cnt_ = 0;
+
+  if (ftruncate(fd_, static_cast<off_t>(page_cnt) * PAGE_SIZE) < 0) {
+    std::cout << "[LiteDB-Error]  Failed to truncate " << path_ << ": "
+              << strerror(errno) << "\r\n";
+    return true;
+  }
+
+  page_cnt_ = page_cnt;
+  return sync();
+}
+
+size_t DiskFile::diskBytes() {
+  struct stat st;
+  if (fd_ < 0 || fstat(fd_, &st) < 0) return 0;
+  return static_cast<size_t>(st.st_blocks) * 512;
+}
+
+bool DiskFile::sync() {
+  if (fdatasync(fd_) < 0) {
+    std::cout << "[LiteDB-Error]  Failed to sync " << path_ << ": "
+              << strerror(errno) << "\r\n";
+    return true;
+  }
+
+  return false;
+}
+
+}  // namespace litedb
\ No newline at end of file
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace litedb {
+
+// 数据文件按固定大小的页读写，内存中的页和磁盘上的页格式完全相同
+#define PAGE_SIZE (16 * 1024)
+// 文件系统分配磁盘空间的单位，页末尾全为 0 的块写回时打洞释放
+#define DISK_BLOCK_SIZE 4096
+
+// 所有数据页的前 8 字节是页的 LSN，即最后一次修改这一页的日志记录的 LSN
+inline uint64_t PageLsn(const char* page) {
+  uint64_t lsn;
+  memcpy(&lsn, page, sizeof(lsn));
+  return lsn;
+}
+
+inline void SetPageLsn(char* page, uint64_t lsn) {
+  memcpy(page, &lsn, sizeof(lsn));
+}
+
+class DiskFile {
+ public:
+  DiskFile()
+      : fd_(-1), page_cnt_(0), map_enabled_(false), map_(nullptr),
+        map_cnt_(0) {}
+  ~DiskFile() { close(); }
+
+  // 文件不存在时创建空文件
+  bool open(const std::string& path);
+  void close();
+
+  bool readPage(uint32_t page_no, void* buf);
+  // 覆盖文件中已有的页时，页末尾全为 0 的块不写入，而是打洞释放空间
+  bool writePage(uint32_t page_no, const void* buf);
+  // 释放页占用的磁盘空间，之后读到的页全为 0
+  bool punchPage(uint32_t page_no);
+  // 把文件截断为 page_cnt 页并 sync，调用前要先丢弃缓冲池中被截掉的页
+  bool truncate(uint32_t page_cnt);
+  bool sync();
+
+  // 之后可以通过 mappedPage 从只读的文件映射中直接读页
+  void enableMap() { map_enabled_ = true; }
+  // 返回映射中的页，没有开启映射、页超出文件末尾或映射失败时返回 nullptr。
+  // 页被写回之后映射中的内容随之更新。文件变长时会重新映射，之前返回的
+  // 地址失效
+  const char* mappedPage(uint32_t page_no);
+
+  uint32_t pageCount() { return page_cnt_; }
+  // 文件实际占用的磁盘空间，不包括打洞释放的部分
+  size_t diskBytes();
+  const std::string& path() { return path_; }
+
+ private:
+  int fd_;
+  // 后台检查点线程也会写页
+  std::atomic<uint32_t> page_cnt_;
+  bool map_enabled_;
+  char* map_;
+  uint32_t map_cnt_;
+  std::string path_;
+};
+
+// 数据目录，保存 catalog 和所有表的数据文件
+extern std::string g_data_dir;
+
+// 读为主的模式 (--mmap)：表的数据文件映射到内存，缓冲池中没有的页直接从
+// 映射中读取，只有修改的页才读入缓冲池
+extern bool g_use_mmap;
+
+// 编号为 id 的对象的数据文件路径，如 data/3.tbl
+std::string DataFilePath(uint32_t id, const char* suffix);
+
+}  // namespace litedb
\ No newline at end of file
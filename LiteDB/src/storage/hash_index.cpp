@@ -0,0 +1,89 @@
+#include "hash_index.h"
+
+#include <utility>
+
+#include "storage/statistics.h"
+
+namespace litedb {
+
+HashIndex::HashIndex() { clear(); }
+
+void HashIndex::clear() {
+  segments_.clear();
+  segments_.emplace_back(HASH_INDEX_SEGMENT_BUCKETS);
+  level_size_ = HASH_INDEX_INIT_BUCKETS;
+  split_ = 0;
+  size_ = 0;
+  key_bytes_ = 0;
+}
+
+size_t HashIndex::memoryBytes() const {
+  return segments_.size() * HASH_INDEX_SEGMENT_BUCKETS * sizeof(Bucket) +
+         size_ * sizeof(Entry) + key_bytes_;
+}
+
+size_t HashIndex::bucketIndex(uint64_t hash) const {
+  size_t idx = hash & (level_size_ - 1);
+  if (idx < split_) idx = hash & (level_size_ * 2 - 1);
+  return idx;
+}
+
+void HashIndex::insert(const std::string& key, uint64_t value) {
+  uint64_t hash = StatsHash(key.data(), key.size());
+  bucket(bucketIndex(hash)).emplace_back(Entry{hash, value, key});
+  size_++;
+  key_bytes_ += key.size();
+  if (size_ > HASH_INDEX_LOAD * (level_size_ + split_)) split();
+}
+
+bool HashIndex::remove(const std::string& key, uint64_t value) {
+  uint64_t hash = StatsHash(key.data(), key.size());
+  Bucket& entries = bucket(bucketIndex(hash));
+  for (size_t i = 0; i < entries.size(); i++) {
+    Entry& entry = entries[i];
+    if (entry.hash != hash || entry.value != value || entry.key != key)
+      continue;
+
+    if (i + 1 != entries.size()) entry = std::move(entries.back());
+    entries.pop_back();
+    size_--;
+    key_bytes_ -= key.size();
+    return false;
+  }
+
+  return true;
+}
+
+void HashIndex::lookup(const std::string& key,
+                       std::vector<uint64_t>* values) const {
+  uint64_t hash = StatsHash(key.data(), key.size());
+  for (auto& entry : bucket(bucketIndex(hash)))
+    if (entry.hash == hash && entry.key == key)
+      values->emplace_back(entry.value);
+}
+
+void HashIndex::split() {
+  size_t to = level_size_ + split_;
+  if (to / HASH_INDEX_SEGMENT_BUCKETS == segments_.size())
+    segments_.emplace_back(HASH_INDEX_SEGMENT_BUCKETS);
+
+  Bucket& from_bucket = bucket(split_);
+  Bucket& to_bucket = bucket(to);
+  size_t mask = level_size_ * 2 - 1;
+  size_t kept = 0;
+  for (size_t i = 0; i < from_bucket.size(); i++) {
+    if ((from_bucket[i].hash & mask) == to)
+      to_bucket.emplace_back(std::move(from_bucket[i]));
+    else if (kept++ != i)
+      from_bucket[kept - 1] = std::move(from_bucket[i]);
+  }
+  from_bucket.resize(kept);
+
+  // 所有的桶都分裂之后桶数翻倍，开始新的一轮
+  if (++split_ == level_size_) {
+    level_size_ *= 2;
+    split_ = 0;
+  }
+}
+
+}  // namespace litedb
\ No newline at end of file
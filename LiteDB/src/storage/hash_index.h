@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace litedb {
+
+// 平均每个桶的项数超过这个值时分裂一个桶
+#define HASH_INDEX_LOAD 4
+// 初始的桶数，必须是 2 的幂
+#define HASH_INDEX_INIT_BUCKETS 16
+// 桶按段分配，每段的桶数。增加桶时不会移动已有的桶
+#define HASH_INDEX_SEGMENT_BUCKETS 1024
+
+// 内存中的哈希索引，键是字符串，值是 uint64_t，键可以重复。用线性哈希
+// (linear hashing) 实现：项数超过桶数的 HASH_INDEX_LOAD 倍时，按顺序把
+// 下一个桶拆成两个，每次插入最多重新分配一个桶中的项，不会一次重新哈希
+// 所有的项。删除时不合并桶。相同的键在同一个桶中，删除时要逐个比较，
+// 适合取值大多不同的列。
+class HashIndex {
+ public:
+  HashIndex();
+
+  void insert(const std::string& key, uint64_t value);
+  // 键和值都相同的项不存在时返回 true
+  bool remove(const std::string& key, uint64_t value);
+  // 把键等于 key 的所有项的值追加到 values
+  void lookup(const std::string& key, std::vector<uint64_t>* values) const;
+  void clear();
+  // 依次对每一项调用 func(key, value)
+  template <typename Func>
+  void forEach(Func func) const {
+    for (auto& segment : segments_)
+      for (auto& entries : segment)
+        for (auto& entry : entries) func(entry.key, entry.value);
+  }
+
+  size_t size() const { return size_; }
+  // 桶和项占用的内存，不计 std::string 内部的预留空间
+  size_t memoryBytes() const;
+
+ private:
+  struct Entry {
+    uint64_t hash;
+    uint64_t value;
+    std::string key;
+  };
+  typedef std::vector<Entry> Bucket;
+
+  size_t bucketIndex(uint64_t hash) const;
+  Bucket& bucket(size_t idx) {
+    return segments_[idx / HASH_INDEX_SEGMENT_BUCKETS]
+                    [idx % HASH_INDEX_SEGMENT_BUCKETS];
+  }
+  const Bucket& bucket(size_t idx) const {
+    return segments_[idx / HASH_INDEX_SEGMENT_BUCKETS]
+                    [idx % HASH_INDEX_SEGMENT_BUCKETS];
+  }
+  // 把第 split_ 个桶中的项分到它和新增的第 level_size_ + split_ 个桶
+  void split();
+
+  std::vector<std::vector<Bucket>> segments_;
+  // 本轮分裂开始时的桶数。下标小于 split_ 的桶已经分裂，用哈希值的低
+  // log2(level_size_) + 1 位选择桶，其他的桶用低 log2(level_size_) 位
+  size_t level_size_;
+  size_t split_;
+  size_t size_;
+  size_t key_bytes_;
+};
+
+}  // namespace litedb
\ No newline at end of file
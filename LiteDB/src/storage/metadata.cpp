@@ -1,7 +1,16 @@
 #include "metadata.h"
 
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 
+#include "storage/checkpoint.h"
 #include "util.h"
 
 using namespace hsql;
@@ -10,8 +19,10 @@ namespace litedb {
 
 MetaData g_meta_data;
 
-Table::Table(char* schema, char* name,
-             std::vector<ColumnDefinition*>* columns) {
+Table::Table(uint32_t id, char* schema, char* name,
+             std::vector<ColumnDefinition*>* columns, TupleLayout layout,
+             bool dict_encoding)
+    : id_(id) {
   schema_ = strdup(schema);
   name_ = strdup(name);
   for (auto col_old : *columns) {
@@ -24,16 +35,113 @@ Table::Table(char* schema, char* name,
     columns_.emplace_back(col);
   }
 
-  table_store_ = new TableStore(&columns_);
+  table_store_ = new TableStore(&columns_, layout, dict_encoding);
 }
 
 Table::~Table() {
   free(schema_);
   free(name_);
   delete table_store_;
+  for (auto index : indexes_) delete index;
   for (auto col : columns_) delete col;
 }
 
+bool Table::open() {
+  if (table_store_->open(id_)) return true;
+
+  std::vector<TableIndex*> indexes;
+  for (auto index : indexes_) indexes.emplace_back(&index->data);
+  return table_store_->openIndexes(indexes);
+}
+
+std::string Table::definition() {
+  std::ostringstream out;
+  out << "table " << id_ << " " << schema_ << " " << name_ << " "
+      << table_store_->layout() << " " << table_store_->dictEncoding() << " "
+      << columns_.size() << " " << indexes_.size() << "\n";
+  for (auto col : columns_) {
+    out << "column " << col->name << " "
+        << static_cast<int>(col->type.data_type) << " " << col->type.length
+        << " " << col->nullable << " " << col->column_constraints->size();
+    for (auto constraint : *col->column_constraints)
+      out << " " << static_cast<int>(constraint);
+    out << "\n";
+  }
+  for (auto index : indexes_) {
+    out << "index " << index->name << " " << index->data.type << " "
+        << index->columns.size();
+    for (auto col : index->columns) out << " " << col->name;
+    out << "\n";
+  }
+  return out.str();
+}
+
+Table* Table::parse(std::istream& in, int version) {
+  uint32_t id;
+  std::string word, schema, name;
+  int layout, dict_encoding = 0;
+  size_t col_num = 0, index_num = 0;
+  in >> id >> schema >> name >> layout;
+  if (version >= 3) in >> dict_encoding;
+  in >> col_num;
+  if (version >= 4) in >> index_num;
+
+  std::vector<ColumnDefinition*> columns;
+  for (size_t i = 0; i < col_num && !in.fail(); i++) {
+    std::string col_name;
+    int data_type, nullable;
+    int64_t length;
+    size_t constraint_num = 0;
+    in >> word >> col_name >> data_type >> length >> nullable >>
+        constraint_num;
+
+    auto column_constraints = new std::unordered_set<ConstraintType>();
+    for (size_t j = 0; j < constraint_num; j++) {
+      int constraint;
+      in >> constraint;
+      column_constraints->emplace(static_cast<ConstraintType>(constraint));
+    }
+
+    ColumnType type(static_cast<DataType>(data_type), length);
+    ColumnDefinition* col = new ColumnDefinition(strdup(col_name.c_str()),
+                                                 type, column_constraints);
+    col->nullable = nullable;
+    columns.emplace_back(col);
+  }
+
+  Table* table = nullptr;
+  if (!in.fail())
+    table = new Table(id, const_cast<char*>(schema.c_str()),
+                      const_cast<char*>(name.c_str()), &columns,
+                      static_cast<TupleLayout>(layout), dict_encoding);
+  for (auto col : columns) delete col;
+
+  // 索引的列按名字对应到表的列
+  for (size_t i = 0; i < index_num && table != nullptr; i++) {
+    std::string index_name, col_name;
+    int index_type = kBTreeIndex;
+    size_t index_col_num = 0;
+    in >> word >> index_name;
+    if (version >= 5) in >> index_type;
+    in >> index_col_num;
+
+    std::vector<ColumnDefinition*> index_columns;
+    for (size_t j = 0; j < index_col_num && !in.fail(); j++) {
+      in >> col_name;
+      ColumnDefinition* col = table->getColumn(&col_name[0]);
+      if (col != nullptr) index_columns.emplace_back(col);
+    }
+    if (in.fail() || index_columns.size() != index_col_num) {
+      delete table;
+      return nullptr;
+    }
+    table->indexes_.emplace_back(table->newIndex(
+        index_name.c_str(), index_columns, static_cast<IndexType>(index_type)));
+  }
+
+  return table;
+}
+
 ColumnDefinition* Table::getColumn(char* name) {
   if (name == nullptr || strlen(name) == 0) return nullptr;
 
@@ -47,70 +155,116 @@ Index* Table::getIndex(char* name) {
   if (name == nullptr || strlen(name) == 0) return nullptr;
 
   for (auto index : indexes_)
-    if (strcmp(name, index->name)) return index;
+    if (strcmp(name, index->name) == 0) return index;
+
+  return nullptr;
+}
+
+Index* Table::newIndex(const char* name,
+                       const std::vector<ColumnDefinition*>& columns,
+                       IndexType type) {
+  Index* index = new Index();
+  index->name = strdup(name);
+  index->data.type = type;
+  for (auto col : columns) {
+    for (size_t i = 0; i < columns_.size(); i++) {
+      if (strcmp(columns_[i]->name, col->name) == 0) {
+        index->columns.emplace_back(columns_[i]);
+        index->data.cols.emplace_back(i);
+        break;
+      }
+    }
+  }
+  return index;
+}
+
+bool Table::addIndex(Index* index) {
+  if (table_store_->addIndex(&index->data)) return true;
+  indexes_.emplace_back(index);
+  return false;
+}
+
+Index* Table::removeIndex(const char* name) {
+  for (size_t i = 0; i < indexes_.size(); i++) {
+    Index* index = indexes_[i];
+    if (strcmp(index->name, name) == 0) {
+      table_store_->removeIndex(&index->data);
+      indexes_.erase(indexes_.begin() + i);
+      return index;
+    }
+  }
 
   return nullptr;
 }
 
+Table* Table::emptyCopy(uint32_t id) {
+  Table* table = new Table(id, schema_, name_, &columns_,
+                           table_store_->layout(),
+                           table_store_->dictEncoding());
+  for (auto index : indexes_)
+    table->indexes_.emplace_back(
+        table->newIndex(index->name, index->columns, index->data.type));
+  return table;
+}
+
 bool MetaData::insertTable(Table* table) {
   if (getTable(table->schema(), table->name()) != nullptr) return true;
 
   TableName table_name;
   SetTableName(table_name, table->schema(), table->name());
+  if (g_wal.logCreateTable(table)) return true;
   table_map_.emplace(table_name, table);
+  if (save()) {
+    table_map_.erase(table_name);
+    return true;
+  }
+  if (table->id() >= next_table_id_) next_table_id_ = table->id() + 1;
   return false;
 }
 
-bool MetaData::dropIndex(char* schema, char* name, char* indexName) {
-  Table* table = getTable(schema, name);
-  if (table == nullptr) {
-    std::cout << "[LiteDB-Error]  Table " << TableNameToString(schema, name)
-              << " did not exist!\r\n";
+// 构建失败时也要记录新建表，日志中删除和新建总是成对出现
+bool MetaData::createIndex(Table* table, Index* index) {
+  if (g_wal.logDropTable(table)) return true;
+  if (table->addIndex(index)) {
+    g_wal.logCreateTable(table);
     return true;
   }
-
-  std::vector<Index*>& indexes = *table->indexes();
-  for (size_t i = 0; i < indexes.size(); i++) {
-    Index* index = indexes[i];
-    if (strcmp(index->name, indexName) == 0) {
-      indexes.erase(indexes.begin() + i);
-      return false;
-    }
+  if (g_wal.logCreateTable(table) || save()) {
+    table->removeIndex(index->name);
+    return true;
   }
 
-  return true;
+  return false;
 }
 
-bool MetaData::dropIndex(char* schema, char* name, char* indexName,
-                         Index** index) {
-  if (index == nullptr) return true;
+bool MetaData::dropIndex(char* index_name) {
+  Table* table;
+  Index* index;
+  if (dropIndex(index_name, &table, &index)) return true;
 
-  Table* table = getTable(schema, name);
-  if (table == nullptr) {
-    std::cout << "[LiteDB-Error]  Table " << TableNameToString(schema, name)
-              << " did not exist!\r\n";
-    return true;
-  }
+  delete index;
+  return false;
+}
 
-  std::vector<Index*>& indexes = *table->indexes();
-  for (size_t i = 0; i < indexes.size(); i++) {
-    *index = indexes[i];
-    if (strcmp((*index)->name, indexName) == 0) return false;
-  }
+bool MetaData::dropIndex(char* index_name, Table** table, Index** index) {
+  *index = getIndex(index_name, table);
+  if (*index == nullptr || g_wal.logDropTable(*table)) return true;
 
-  return true;
+  (*table)->removeIndex(index_name);
+  return g_wal.logCreateTable(*table) || save();
 }
 
 bool MetaData::dropTable(char* schema, char* name) {
   Table* table = getTable(schema, name);
-  if (table == nullptr) return true;
+  if (table == nullptr || g_wal.logDropTable(table)) return true;
 
   TableName table_name;
   SetTableName(table_name, schema, name);
   table_map_.erase(table_name);
   delete table;
+  sweep_files_ = true;
 
-  return false;
+  return save();
 }
 
 // 第三个参数返回 Table 的地址
@@ -118,12 +272,38 @@ bool MetaData::dropTable(char* schema, char* name, Table** table) {
   if (table == nullptr) return true;
 
   *table = getTable(schema, name);
+  if (*table == nullptr || g_wal.logDropTable(*table)) return true;
+
+  TableName table_name;
+  SetTableName(table_name, schema, name);
+  table_map_.erase(table_name);
+  sweep_files_ = true;
+  return save();
+}
+
+// 日志中依次记录删除原来的表和新建空表，恢复时按日志重做或撤销，不需要
+// 逐行记录
+bool MetaData::truncateTable(char* schema, char* name, Table** table) {
   if (table == nullptr) return true;
 
+  *table = getTable(schema, name);
+  if (*table == nullptr) return true;
+
+  Table* empty = (*table)->emptyCopy(newTableId());
+  if (empty->open() || g_wal.logDropTable(*table) ||
+      g_wal.logCreateTable(empty)) {
+    delete empty;
+    return true;
+  }
+
+  // table_map_ 的键引用表自己的名字
   TableName table_name;
   SetTableName(table_name, schema, name);
   table_map_.erase(table_name);
-  return false;
+  SetTableName(table_name, empty->schema(), empty->name());
+  table_map_.emplace(table_name, empty);
+  sweep_files_ = true;
+  return save();
 }
 
 bool MetaData::dropSchema(char* schema) {
@@ -132,16 +312,21 @@ bool MetaData::dropSchema(char* schema) {
   while (iter != table_map_.end()) {
     Table* table = iter->second;
     if (strcmp(table->schema(), schema) == 0) {
+      if (g_wal.logDropTable(table)) {
+        save();
+        return true;
+      }
       std::cout << "[LiteDB-Info]  Drop table " << table->name()
                 << " in schema " << schema << "\r\n";
       iter = table_map_.erase(iter);
       delete table;
+      sweep_files_ = true;
       ret = false;
     } else {
       iter++;
     }
   }
-  return ret;
+  return ret || save();
 }
 
 // 第二个参数返回 Tables 的地址
@@ -151,16 +336,21 @@ bool MetaData::dropSchema(char* schema, std::vector<Table*>* tables) {
   while (iter != table_map_.end()) {
     Table* table = iter->second;
     if (strcmp(table->schema(), schema) == 0) {
+      if (g_wal.logDropTable(table)) {
+        save();
+        return true;
+      }
       std::cout << "[LiteDB-Info]  Drop table " << table->name()
                 << " in schema " << schema << "\r\n";
       iter = table_map_.erase(iter);
       tables->emplace_back(table);
+      sweep_files_ = true;
       ret = false;
     } else {
       iter++;
     }
   }
-  return ret;
+  return ret || save();
 }
 
 void MetaData::getAllTables(std::vector<Table*>* tables) {
@@ -194,16 +384,229 @@ Table* MetaData::getTable(char* schema, char* name) {
     return iter->second;
 }
 
-Index* MetaData::getIndex(char* schema, char* name, char* index_name) {
-  Table* table = getTable(schema, name);
-  if (table == nullptr) {
-    std::cout << "[LiteDB-Error]  Table " << TableNameToString(schema, name)
-              << " did not exist!\\r\n";
-    return nullptr;
+/*
+catalog 是文本文件，版本 5 的格式如下：
+  LiteDB-Catalog 5
+  next_table_id <id>
+  table <id> <schema> <name> <layout> <是否字典编码> <列数> <索引数>
+  column <name> <data_type> <length> <nullable> <约束数> <约束>...
+  index <name> <类型> <列数> <列名>...
+每个 table 行之后紧跟它的所有 column 行，然后是所有 index 行。layout、
+data_type 和索引类型都是枚举的整数值，索引类型 0 是 B+ 树，1 是哈希。
+旧版本的 table 行没有是否字典编码 (版本 3 之前) 和索引数 (版本 4 之前)，
+版本 4 的 index 行没有类型。catalog 在 DDL 时直接改写，改写前 DDL 已经
+写入日志，恢复时由日志重做或撤销。
+*/
+#define CATALOG_MAGIC "LiteDB-Catalog"
+
+static std::string CatalogPath() { return g_data_dir + "/catalog"; }
+
+bool MetaData::load() {
+  if (mkdir(g_data_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+    std::cout << "[LiteDB-Error]  Failed to create data directory "
+              << g_data_dir << ": " << strerror(errno) << "\r\n";
+    return true;
+  }
+
+  std::ifstream in(CatalogPath());
+  if (in.is_open()) {
+    std::string word;
+    int version;
+    in >> word >> version;
+    if (word != CATALOG_MAGIC || version < 2 || version > CATALOG_VERSION) {
+      std::cout << "[LiteDB-Error]  Invalid catalog " << CatalogPath()
+                << "\r\n";
+      return true;
+    }
+
+    in >> word >> next_table_id_;
+    while (in >> word) {
+      Table* table = Table::parse(in, version);
+      if (table == nullptr) {
+        std::cout << "[LiteDB-Error]  Invalid catalog " << CatalogPath()
+                  << "\r\n";
+        return true;
+      }
+
+      TableName table_name;
+      SetTableName(table_name, table->schema(), table->name());
+      table_map_.emplace(table_name, table);
+    }
+  }
+
+  // 恢复直接修改数据文件和 catalog，完成后才能打开表
+  if (g_wal.open()) return true;
+
+  for (auto iter : table_map_) {
+    Table* table = iter.second;
+    if (table->open()) {
+      std::cout << "[LiteDB-Error]  Failed to open table "
+                << TableNameToString(table->schema(), table->name())
+                << "\r\n";
+      return true;
+    }
+  }
+
+  return removeUnusedFiles();
+}
+
+// 先写临时文件再 rename，保证 catalog 总是完整的
+bool MetaData::save() {
+  std::string tmp_path = CatalogPath() + ".tmp";
+  FILE* file = fopen(tmp_path.c_str(), "w");
+  if (file == nullptr) {
+    std::cout << "[LiteDB-Error]  Failed to open " << tmp_path << ": "
+              << strerror(errno) << "\r\n";
+    return true;
+  }
+
+  fprintf(file, "%s %d\n", CATALOG_MAGIC, CATALOG_VERSION);
+  fprintf(file, "next_table_id %u\n", next_table_id_);
+  for (auto iter : table_map_)
+    fputs(iter.second->definition().c_str(), file);
+
+  bool err = (fflush(file) != 0 || fsync(fileno(file)) != 0);
+  err = (fclose(file) != 0) || err;
+  if (err || rename(tmp_path.c_str(), CatalogPath().c_str()) != 0) {
+    std::cout << "[LiteDB-Error]  Failed to write catalog: "
+              << strerror(errno) << "\r\n";
+    return true;
+  }
+
+  return false;
+}
+
+bool MetaData::commit() {
+  // 字典中新的条目先于引用它们的提交持久化
+  for (auto iter : table_map_) {
+    TableStore* table_store = iter.second->getTableStore();
+    table_store->releasePages();
+    if (table_store->syncDictionary()) return true;
+  }
+  if (g_wal.commit()) return true;
+
+  if (sweep_files_) {
+    sweep_files_ = false;
+    if (removeUnusedFiles()) return true;
+  }
+
+  // 后台检查点不在主线程，不能访问表的内存结构，之后的第一次提交时补上。
+  // 这时没有未提交的修改，索引和恢复之后的数据一致
+  uint64_t checkpoints = g_checkpointer.completed();
+  if (checkpoints != saved_checkpoints_) {
+    saved_checkpoints_ = checkpoints;
+    for (auto iter : table_map_)
+      if (iter.second->getTableStore()->saveFiles()) return true;
+  }
+
+  if (g_wal.size() > WAL_CHECKPOINT_SIZE) g_checkpointer.request();
+  return false;
+}
+
+// 先由 TableStore 写回各自的脏页并给释放的字符串页打洞，再做一次检查点
+// 截断日志。在事务中调用时保留事务的日志
+bool MetaData::checkpoint() {
+  for (auto iter : table_map_)
+    if (iter.second->getTableStore()->flush()) return true;
+
+  return g_checkpointer.run();
+}
+
+bool MetaData::vacuum(Table* table, bool freeze, VacuumStats* stats) {
+  std::vector<Table*> tables;
+  if (table != nullptr)
+    tables.emplace_back(table);
+  else
+    getAllTables(&tables);
+
+  *stats = {0, 0, 0, 0};
+  for (auto t : tables) {
+    TableStore* table_store = t->getTableStore();
+    if (table_store->compact(&stats->moved) ||
+        table_store->merge(true, &stats->merged) ||
+        (freeze && table_store->freeze(&stats->frozen)))
+      return true;
   }
 
-  for (auto index : *table->indexes())
-    if (strcmp(index->name, index_name) == 0) return index;
+  // 日志中不能再有被截掉的页的记录
+  if (commit() || checkpoint()) return true;
+
+  for (auto t : tables)
+    if (t->getTableStore()->shrink(&stats->freed)) return true;
+  return false;
+}
+
+// 合并修改的页和普通的写入一样记录日志，合并之后单独提交
+bool MetaData::mergeDelta() {
+  size_t merged = 0;
+  for (auto iter : table_map_) {
+    TableStore* table_store = iter.second->getTableStore();
+    if (table_store->needMerge() && table_store->merge(false, &merged))
+      return true;
+  }
+
+  return merged > 0 && commit();
+}
+
+bool MetaData::analyze(Table* table, int64_t* rows) {
+  std::vector<Table*> tables;
+  if (table != nullptr)
+    tables.emplace_back(table);
+  else
+    getAllTables(&tables);
+
+  *rows = 0;
+  for (auto t : tables) {
+    TableStore* table_store = t->getTableStore();
+    if (table_store->analyze()) return true;
+    *rows += table_store->stats()->rowCount();
+  }
+
+  return false;
+}
+
+// 数据文件名是 <表 id>.tbl、<表 id>.str、<表 id>.dic、<表 id>.sta 和
+// <表 id>.idx
+bool MetaData::removeUnusedFiles() {
+  std::unordered_set<uint32_t> ids;
+  for (auto iter : table_map_) ids.emplace(iter.second->id());
+
+  DIR* dir = opendir(g_data_dir.c_str());
+  if (dir == nullptr) {
+    std::cout << "[LiteDB-Error]  Failed to open data directory "
+              << g_data_dir << ": " << strerror(errno) << "\r\n";
+    return true;
+  }
+
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    uint32_t id;
+    char suffix[8];
+    if (sscanf(entry->d_name, "%u.%3s", &id, suffix) != 2 ||
+        (strcmp(suffix, "tbl") != 0 && strcmp(suffix, "str") != 0 &&
+         strcmp(suffix, "dic") != 0 && strcmp(suffix, "sta") != 0 &&
+         strcmp(suffix, "idx") != 0) ||
+        ids.count(id) > 0)
+      continue;
+
+    std::string path = g_data_dir + "/" + entry->d_name;
+    if (unlink(path.c_str()) != 0)
+      std::cout << "[LiteDB-Error]  Failed to remove " << path << ": "
+                << strerror(errno) << "\r\n";
+  }
+
+  closedir(dir);
+  return false;
+}
+
+Index* MetaData::getIndex(char* index_name, Table** table) {
+  for (auto iter : table_map_) {
+    Index* index = iter.second->getIndex(index_name);
+    if (index != nullptr) {
+      if (table != nullptr) *table = iter.second;
+      return index;
+    }
+  }
 
   return nullptr;
 }
@@ -2,6 +2,8 @@
 
 #include <string.h>
 
+#include <istream>
+#include <string>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -42,26 +44,66 @@ struct equal_to<TableName> {
 
 namespace litedb {
 
+// catalog 文件的版本，版本 3 在表的定义中增加了是否字典编码，版本 4 增加
+// 了索引，版本 5 增加了索引的类型
+#define CATALOG_VERSION 5
+
+// 索引的定义和数据。columns 指向所属表的列定义，索引名在所有表中唯一
 struct Index {
+  Index() : name(nullptr) {}
+  ~Index() { free(name); }
+
   char* name;
   std::vector<ColumnDefinition*> columns;
+  TableIndex data;
+};
+
+// VACUUM 移动的行数、释放的页数、合并的页数和冻结的页数
+struct VacuumStats {
+  size_t moved;
+  size_t freed;
+  size_t merged;
+  size_t frozen;
 };
 
+// 表的数据保存在以 id 命名的数据文件中。删除表时数据文件不会马上删除，
+// 删除表的事务提交后由 MetaData 统一清理。
 class Table {
  public:
-  Table(char* schema, char* name, std::vector<ColumnDefinition*>* columns);
+  Table(uint32_t id, char* schema, char* name,
+        std::vector<ColumnDefinition*>* columns, TupleLayout layout,
+        bool dict_encoding = false);
   ~Table();
 
+  // 打开表的数据文件并构建所有的索引，新建的表会创建空的数据文件
+  bool open();
+  // 表在 catalog 中的文本定义，以 "table" 开头，包括所有的列
+  std::string definition();
+  // 从 in 中读取 definition() 的内容，"table" 已经被读出。version 是写入
+  // 定义时的 catalog 版本。失败时返回 nullptr，返回的表还没有打开
+  static Table* parse(std::istream& in, int version = CATALOG_VERSION);
+
   ColumnDefinition* getColumn(char* name);
   Index* getIndex(char* name);
+  // 在表中与 columns 同名的列上新建索引，返回的索引还没有加入表
+  Index* newIndex(const char* name,
+                  const std::vector<ColumnDefinition*>& columns,
+                  IndexType type = kBTreeIndex);
+  // 构建索引的数据并加入表，表要已经打开
+  bool addIndex(Index* index);
+  // 从表中移除索引并返回，索引不存在时返回 nullptr
+  Index* removeIndex(const char* name);
+  // 定义和索引都相同的空表，编号为 id，还没有打开
+  Table* emptyCopy(uint32_t id);
+  uint32_t id() { return id_; };
   char* schema() { return schema_; };
   char* name() { return name_; };
   std::vector<ColumnDefinition*>* columns() { return &columns_; };
   std::vector<Index*>* indexes() { return &indexes_; };
-  void addIndex(Index* index) { indexes_.emplace_back(index); };
   TableStore* getTableStore() { return table_store_; };
 
  private:
+  uint32_t id_;
   char* schema_;
   char* name_;
   std::vector<ColumnDefinition*> columns_;
@@ -71,25 +113,64 @@ class Table {
 
 class MetaData {
  public:
-  MetaData(){};
+  MetaData()
+      : next_table_id_(1), sweep_files_(false), saved_checkpoints_(0){};
   ~MetaData(){};
 
+  // 从数据目录中的 catalog 加载所有的表并根据日志恢复，数据目录不存在时
+  // 创建
+  bool load();
+  // 提交当前事务：把所有表的修改写入日志并持久化。日志过大时唤醒后台
+  // 检查点线程，后台检查点完成之后写入各个表的统计信息和索引文件
+  bool commit();
+  // 在当前线程做一次检查点，把所有表修改过的页写回数据文件并截断日志
+  bool checkpoint();
+  // 压缩 table 中稀疏的 tuple group，table 为 nullptr 时压缩所有的表。压缩
+  // 的修改提交并做过检查点之后，文件末尾空出来的页才归还给文件系统。
+  // 混合布局的表同时合并所有写满的 delta。freeze 为 true 时再冻结写满的
+  // tuple group
+  bool vacuum(Table* table, bool freeze, VacuumStats* stats);
+  // 合并 delta 已经足够多的表并提交，在事务之外的语句提交之后调用
+  bool mergeDelta();
+  // 重新统计 table 的统计信息，table 为 nullptr 时统计所有的表。rows 返回
+  // 扫描的行数
+  bool analyze(Table* table, int64_t* rows);
+  uint32_t newTableId() { return next_table_id_++; }
+
   // 部分函数有额外参数，用于定位对象内存地址，在事务管理时要用到
   bool insertTable(Table* table);
-  bool dropIndex(char* schema, char* name, char* indexName);
-  bool dropIndex(char* schema, char* name, char* indexName, Index** index);
+  // 索引的修改在日志中记录为删除原来的表定义再新建修改后的定义，恢复时和
+  // 表一样重做或撤销。index 构建完成后加入 table
+  bool createIndex(Table* table, Index* index);
+  bool dropIndex(char* index_name);
+  // 后两个参数返回索引所在的表和索引的地址，索引由调用者释放
+  bool dropIndex(char* index_name, Table** table, Index** index);
   bool dropTable(char* schema, char* name);
   bool dropTable(char* schema, char* name, Table** table);
+  // 用一张新编号、定义和索引都相同的空表替换原来的表。原来的表通过
+  // table 返回，由调用者在事务提交后删除，数据文件在提交后清理
+  bool truncateTable(char* schema, char* name, Table** table);
   bool dropSchema(char* schema);
   bool dropSchema(char* schema, std::vector<Table*>* tables);
   void getAllTables(std::vector<Table*>* tables);
 
   bool findSchema(char* schema);
   Table* getTable(char* schema, char* name);
-  Index* getIndex(char* schema, char* name, char* index_name);
+  // 在所有表中查找索引，table 不为 nullptr 时返回索引所在的表
+  Index* getIndex(char* index_name, Table** table = nullptr);
 
  private:
+  // 把表的定义写入 catalog，表增删时调用
+  bool save();
+  // 删除 catalog 中已经不存在的表的数据文件
+  bool removeUnusedFiles();
+
   std::unordered_map<TableName, Table*> table_map_;
+  uint32_t next_table_id_;
+  // 删除过表，提交后需要清理数据文件
+  bool sweep_files_;
+  // 上次写入统计信息和索引文件时已经完成的检查点个数
+  uint64_t saved_checkpoints_;
 };
 
 extern MetaData g_meta_data;
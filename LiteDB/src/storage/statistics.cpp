@@ -0,0 +1,276 @@
+#include "statistics.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace litedb {
+
+#define STATS_MAGIC 0x4154534cu
+#define STATS_VERSION 2
+
+// FNV-1a 之后再做一次混合，保证低位和高位都足够随机
+uint64_t StatsHash(const void* data, size_t len) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+// 低 HLL_PRECISION 位选择寄存器，其余位中第一个 1 的位置更新寄存器
+void HyperLogLog::add(uint64_t hash) {
+  size_t idx = hash & (HLL_REGISTERS - 1);
+  uint64_t rest = hash >> HLL_PRECISION;
+  uint8_t rank = (rest == 0) ? 64 - HLL_PRECISION + 1
+                             : __builtin_ctzll(rest) + 1;
+  if (rank > registers_[idx]) registers_[idx] = rank;
+}
+
+double HyperLogLog::estimate() const {
+  double sum = 0;
+  int zeros = 0;
+  for (auto reg : registers_) {
+    sum += std::ldexp(1.0, -reg);
+    if (reg == 0) zeros++;
+  }
+
+  double m = HLL_REGISTERS;
+  double alpha = 0.7213 / (1 + 1.079 / m);
+  double estimate = alpha * m * m / sum;
+  // 基数较小时用线性计数修正
+  if (estimate <= 2.5 * m && zeros > 0) estimate = m * std::log(m / zeros);
+  return estimate;
+}
+
+void Histogram::build(const std::vector<double>& samples, int64_t total) {
+  bounds.clear();
+  counts.clear();
+  if (samples.empty()) return;
+
+  min = samples.front();
+  size_t buckets = std::min<size_t>(HISTOGRAM_BUCKETS, samples.size());
+  size_t begin = 0;
+  for (size_t i = 1; i <= buckets; i++) {
+    size_t end = samples.size() * i / buckets;
+    // 相等的值放在同一个桶中
+    while (end < samples.size() && samples[end] == samples[end - 1]) end++;
+    if (end <= begin) continue;
+
+    bounds.emplace_back(samples[end - 1]);
+    counts.emplace_back(total * (end - begin) / samples.size());
+    begin = end;
+  }
+}
+
+void Histogram::add(double val, int64_t delta) {
+  if (bounds.empty()) {
+    if (delta < 0) return;
+    min = val;
+    bounds.emplace_back(val);
+    counts.emplace_back(0);
+  }
+
+  size_t i = std::lower_bound(bounds.begin(), bounds.end(), val) -
+             bounds.begin();
+  if (i == bounds.size()) bounds[--i] = val;
+  if (val < min) min = val;
+  counts[i] = std::max<int64_t>(counts[i] + delta, 0);
+}
+
+void TableStats::init(const std::vector<bool>& numeric) {
+  numeric_ = numeric;
+  reset();
+}
+
+void TableStats::reset() {
+  size_t col_num = numeric_.size();
+  columns_.assign(col_num, ColumnStats());
+  for (auto& column : columns_) {
+    column.null_cnt = 0;
+    column.histogram.min = 0;
+  }
+  samples_.assign(col_num, std::vector<double>());
+  seen_.assign(col_num, 0);
+  row_cnt_ = 0;
+  analyzed_ = false;
+  stale_ = false;
+  dirty_ = false;
+}
+
+void TableStats::sample(size_t idx, uint64_t hash, const double* val) {
+  columns_[idx].ndv.add(hash);
+  if (val == nullptr) return;
+
+  // 蓄水池采样，每个值被选中的概率相同
+  std::vector<double>& samples = samples_[idx];
+  int64_t seen = seen_[idx]++;
+  if (samples.size() < HISTOGRAM_SAMPLES) {
+    samples.emplace_back(*val);
+  } else {
+    uint64_t pos = rng_() % (seen + 1);
+    if (pos < HISTOGRAM_SAMPLES) samples[pos] = *val;
+  }
+}
+
+void TableStats::finish(int64_t row_cnt) {
+  row_cnt_ = row_cnt;
+  for (size_t i = 0; i < columns_.size(); i++) {
+    std::vector<double>& samples = samples_[i];
+    std::sort(samples.begin(), samples.end());
+    columns_[i].histogram.build(samples, row_cnt - columns_[i].null_cnt);
+  }
+
+  samples_.clear();
+  seen_.clear();
+  analyzed_ = true;
+  stale_ = false;
+  dirty_ = true;
+}
+
+void TableStats::addNull(size_t idx, int delta) {
+  if (!analyzed_) return;
+  columns_[idx].null_cnt += delta;
+  dirty_ = true;
+}
+
+void TableStats::addValue(size_t idx, uint64_t hash, const double* val,
+                          int delta) {
+  if (!analyzed_) return;
+  if (delta > 0) columns_[idx].ndv.add(hash);
+  if (val != nullptr) columns_[idx].histogram.add(*val, delta);
+  dirty_ = true;
+}
+
+double TableStats::distinctCount(size_t idx) {
+  // 删除之后估计值可能超过不为 NULL 的行数
+  double non_null = row_cnt_ - columns_[idx].null_cnt;
+  return std::min(columns_[idx].ndv.estimate(), std::max(non_null, 0.0));
+}
+
+// 文件格式：magic、版本、列数、行数、写入时的 LSN 和是否过期，之后每列依次
+// 是 NULL 个数、是否数值列、HyperLogLog 的寄存器、直方图的下界、桶数和每个
+// 桶的上界与行数。版本 1 没有 LSN 和是否过期
+bool TableStats::load(const std::string& path, uint64_t recovered_lsn) {
+  FILE* file = fopen(path.c_str(), "r");
+  if (file == nullptr) {
+    if (errno == ENOENT) return false;
+    std::cout << "[LiteDB-Error]  Failed to open " << path << ": "
+              << strerror(errno) << "\r\n";
+    return true;
+  }
+
+  uint32_t header[3];
+  uint64_t lsn = 0;
+  uint8_t stale = 0;
+  bool ok = fread(header, sizeof(header), 1, file) == 1 &&
+            header[0] == STATS_MAGIC &&
+            (header[1] == 1 || header[1] == STATS_VERSION) &&
+            header[2] == numeric_.size() &&
+            fread(&row_cnt_, sizeof(row_cnt_), 1, file) == 1;
+  if (ok && header[1] == STATS_VERSION)
+    ok = fread(&lsn, sizeof(lsn), 1, file) == 1 &&
+         fread(&stale, sizeof(stale), 1, file) == 1;
+  for (size_t i = 0; ok && i < columns_.size(); i++) {
+    ColumnStats& column = columns_[i];
+    Histogram& histogram = column.histogram;
+    uint8_t numeric;
+    uint32_t buckets;
+    ok = fread(&column.null_cnt, sizeof(column.null_cnt), 1, file) == 1 &&
+         fread(&numeric, sizeof(numeric), 1, file) == 1 &&
+         numeric == numeric_[i] &&
+         fread(column.ndv.registers().data(), HLL_REGISTERS, 1, file) == 1 &&
+         fread(&histogram.min, sizeof(histogram.min), 1, file) == 1 &&
+         fread(&buckets, sizeof(buckets), 1, file) == 1 &&
+         buckets <= HISTOGRAM_BUCKETS;
+    if (!ok) break;
+
+    histogram.bounds.resize(buckets);
+    histogram.counts.resize(buckets);
+    ok = buckets == 0 ||
+         (fread(histogram.bounds.data(), sizeof(double), buckets, file) ==
+              buckets &&
+          fread(histogram.counts.data(), sizeof(int64_t), buckets, file) ==
+              buckets);
+  }
+  fclose(file);
+
+  // 文件不完整时当作没有统计过
+  if (!ok) {
+    std::cout << "[LiteDB-Info]  Ignore invalid statistics " << path
+              << "\r\n";
+    reset();
+    return false;
+  }
+
+  analyzed_ = true;
+  stale_ = stale != 0;
+  // 重放的修改没有计入统计信息
+  if (recovered_lsn != 0 && recovered_lsn >= lsn && !stale_) {
+    std::cout << "[LiteDB-Info]  Statistics " << path
+              << " are stale after recovery, run ANALYZE to refresh\r\n";
+    stale_ = true;
+    dirty_ = true;
+  }
+  return false;
+}
+
+// 先写临时文件再 rename，保证文件总是完整的
+bool TableStats::save(const std::string& path, uint64_t lsn) {
+  if (!analyzed_ || !dirty_) return false;
+
+  std::string tmp_path = path + ".tmp";
+  FILE* file = fopen(tmp_path.c_str(), "w");
+  if (file == nullptr) {
+    std::cout << "[LiteDB-Error]  Failed to open " << tmp_path << ": "
+              << strerror(errno) << "\r\n";
+    return true;
+  }
+
+  uint32_t header[3] = {STATS_MAGIC, STATS_VERSION,
+                        static_cast<uint32_t>(columns_.size())};
+  uint8_t stale = stale_;
+  fwrite(header, sizeof(header), 1, file);
+  fwrite(&row_cnt_, sizeof(row_cnt_), 1, file);
+  fwrite(&lsn, sizeof(lsn), 1, file);
+  fwrite(&stale, sizeof(stale), 1, file);
+  for (size_t i = 0; i < columns_.size(); i++) {
+    ColumnStats& column = columns_[i];
+    Histogram& histogram = column.histogram;
+    uint8_t numeric = numeric_[i];
+    uint32_t buckets = histogram.bounds.size();
+    fwrite(&column.null_cnt, sizeof(column.null_cnt), 1, file);
+    fwrite(&numeric, sizeof(numeric), 1, file);
+    fwrite(column.ndv.registers().data(), HLL_REGISTERS, 1, file);
+    fwrite(&histogram.min, sizeof(histogram.min), 1, file);
+    fwrite(&buckets, sizeof(buckets), 1, file);
+    fwrite(histogram.bounds.data(), sizeof(double), buckets, file);
+    fwrite(histogram.counts.data(), sizeof(int64_t), buckets, file);
+  }
+
+  bool err = (ferror(file) || fflush(file) != 0 || fsync(fileno(file)) != 0);
+  err = (fclose(file) != 0) || err;
+  if (err || rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::cout << "[LiteDB-Error]  Failed to write " << path << ": "
+              << strerror(errno) << "\r\n";
+    return true;
+  }
+
+  dirty_ = false;
+  return false;
+}
+
+}  // namespace litedb
\ No newline at end of file
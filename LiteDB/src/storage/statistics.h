@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace litedb {
+
+// HyperLogLog 的寄存器个数为 2^HLL_PRECISION，标准误差约 1.04 / sqrt(1024)
+#define HLL_PRECISION 10
+#define HLL_REGISTERS (1 << HLL_PRECISION)
+// 等深直方图的桶数
+#define HISTOGRAM_BUCKETS 32
+// ANALYZE 时每列最多采样这么多个值构建直方图
+#define HISTOGRAM_SAMPLES 30000
+
+// 估计不同值的个数。只能添加不能删除，删除的值在下次 ANALYZE 之前仍然
+// 计入估计值。
+class HyperLogLog {
+ public:
+  HyperLogLog() : registers_(HLL_REGISTERS, 0) {}
+
+  void add(uint64_t hash);
+  double estimate() const;
+  void clear() { registers_.assign(HLL_REGISTERS, 0); }
+
+  std::vector<uint8_t>& registers() { return registers_; }
+
+ private:
+  std::vector<uint8_t> registers_;
+};
+
+// 数值列的等深直方图。ANALYZE 时每个桶的行数相同，bounds[i] 是第 i 个桶
+// 的上界 (包含)，min 是第一个桶的下界。之后插入和删除只修改落入的桶的
+// 计数，桶的边界在下次 ANALYZE 之前不变，超出范围的值计入首尾的桶并扩展
+// 边界。
+struct Histogram {
+  double min;
+  std::vector<double> bounds;
+  std::vector<int64_t> counts;
+
+  // 由排好序的样本构建，total 是列中不为 NULL 的行数
+  void build(const std::vector<double>& samples, int64_t total);
+  void add(double val, int64_t delta);
+};
+
+struct ColumnStats {
+  int64_t null_cnt;
+  HyperLogLog ndv;
+  // 只有 INT/LONG/DOUBLE 列有直方图
+  Histogram histogram;
+};
+
+// 表的统计信息：行数和每列的 NULL 个数、不同值个数的估计和直方图。
+// TableStore 在行对扫描可见或不可见时增量维护，ANALYZE 时重新统计。
+// 统计信息是近似的，检查点之后的第一次提交时写入 <表 id>.sta。崩溃时
+// 丢失上次写入之后的变化，恢复时重放了写入之后的日志的表标记为过期，
+// 直到下次 ANALYZE。没有统计过的表 (旧的数据文件) analyzed() 为 false，
+// 不维护也不能用于估计。
+class TableStats {
+ public:
+  TableStats()
+      : analyzed_(false), stale_(false), dirty_(false), row_cnt_(0) {}
+
+  // numeric 标记哪些列是数值列
+  void init(const std::vector<bool>& numeric);
+  // 清空统计信息，开始重新统计
+  void reset();
+  // ANALYZE 扫描时添加一行的一列，val 为 nullptr 时不是数值列
+  void sample(size_t idx, uint64_t hash, const double* val);
+  void sampleNull(size_t idx) { columns_[idx].null_cnt++; }
+  // 扫描完所有的行之后调用，row_cnt 是扫描的行数
+  void finish(int64_t row_cnt);
+
+  // 增量维护。delta 为 1 时添加、为 -1 时删除
+  void addRow(int delta) { row_cnt_ += delta; }
+  void addNull(size_t idx, int delta);
+  void addValue(size_t idx, uint64_t hash, const double* val, int delta);
+
+  // recovered_lsn 是恢复时重放的这个表的最后一条日志的 LSN
+  bool load(const std::string& path, uint64_t recovered_lsn);
+  // 有变化时写入 path。lsn 之后的日志中的修改不包含在写入的统计信息中
+  bool save(const std::string& path, uint64_t lsn);
+
+  bool analyzed() { return analyzed_; }
+  bool stale() { return stale_; }
+  int64_t rowCount() { return row_cnt_; }
+  int64_t nullCount(size_t idx) { return columns_[idx].null_cnt; }
+  double distinctCount(size_t idx);
+  const Histogram& histogram(size_t idx) { return columns_[idx].histogram; }
+
+ private:
+  bool analyzed_;
+  bool stale_;
+  bool dirty_;
+  int64_t row_cnt_;
+  std::vector<bool> numeric_;
+  std::vector<ColumnStats> columns_;
+  // ANALYZE 时每列的蓄水池采样
+  std::vector<std::vector<double>> samples_;
+  std::vector<int64_t> seen_;
+  std::mt19937_64 rng_;
+};
+
+// 统计信息使用的 64 位哈希
+uint64_t StatsHash(const void* data, size_t len);
+
+}  // namespace litedb
\ No newline at end of file
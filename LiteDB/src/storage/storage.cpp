@@ -1,8 +1,15 @@
 #include "storage.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
 #include <iostream>
+#include <limits>
 
 #include "sql/ColumnType.h"
 #include "sql/Expr.h"
@@ -13,155 +20,734 @@ using namespace hsql;
 
 namespace litedb {
 
-TableStore::TableStore(std::vector<ColumnDefinition*>* columns)
-    : col_num_(columns->size()), tuple_size_(0), columns_(columns) {
-  col_offset_.push_back(0);
+TupleLayout g_default_layout = kRowLayout;
+bool g_dict_encoding = false;
+bool g_persist_indexes = false;
+int g_index_fill_factor = 90;
 
-  // 计算列打印时占用的空间
+#define INDEX_FILE_MAGIC 0x5844494cu
+#define INDEX_FILE_VERSION 1
+// 索引文件中键的最大长度，更长时认为文件已经损坏
+#define INDEX_FILE_MAX_KEY (1 << 20)
+
+// PAX 布局下 slots 个槽位的行数据占用的字节数
+static int PaxDataSize(const std::vector<int>& col_size, int slots) {
+  int size = 0;
+  for (auto col : col_size)
+    size += ((slots + 63) / 64 * 8 + col * slots + 7) & ~7;
+  return size;
+}
+
+TableStore::TableStore(std::vector<ColumnDefinition*>* columns,
+                       TupleLayout layout, bool dict_encoding)
+    : col_num_(columns->size()),
+      tuple_size_(0),
+      group_slots_(0),
+      layout_(layout),
+      dict_encoding_(dict_encoding),
+      columns_(columns),
+      decoded_(columns->size()),
+      group_cnt_(0),
+      frame_(nullptr),
+      frame_group_(0),
+      mapped_page_(nullptr),
+      mapped_group_(0),
+      free_group_(0),
+      file_id_(0),
+      index_file_valid_(false) {
   for (auto col : *columns) {
-    tuple_size_ += ColumnTypeSize(col->type);
-    col_offset_.emplace_back(tuple_size_);
+    int size = ColumnTypeSize(col->type);
+    bool encoded = dict_encoding_ && col->type.data_type == DataType::CHAR &&
+                   col->type.length >= DICT_MIN_CHAR_LENGTH;
+    if (encoded) size = sizeof(uint32_t);
+    encoded_.push_back(encoded);
+    col_size_.emplace_back(size);
+    tuple_size_ += size;
   }
 
+  std::vector<bool> numeric;
+  for (auto col : *columns) {
+    DataType type = col->type.data_type;
+    numeric.push_back(type == DataType::INT || type == DataType::LONG ||
+                      type == DataType::DOUBLE);
+  }
+  stats_.init(numeric);
+
   // NULL 也要保留空间
   tuple_size_ += col_num_;
 
-  // 给表头保留空间
-  tuple_size_ += TUPLE_HEADER_SIZE;
+  // 页头和 zone map 之后是行数据，根据剩余空间计算每页的槽位数
+  data_offset_ = (sizeof(TupleGroup) + col_num_ * sizeof(ZoneMap) + 7) & ~7;
+  int avail = PAGE_SIZE - data_offset_;
+  if (avail > 0) group_slots_ = avail / tuple_size_;
+  if (group_slots_ > TUPLE_GROUP_MAX_SLOTS)
+    group_slots_ = TUPLE_GROUP_MAX_SLOTS;
+  // 混合布局的 tuple group 要能按两种布局存放，PAX 布局的槽位数更少
+  if (layout_ != kRowLayout)
+    while (group_slots_ > 0 && PaxDataSize(col_size_, group_slots_) > avail)
+      group_slots_--;
+  bitmap_words_ = (group_slots_ + 63) / 64;
+
+  row_offset_.push_back(0);
+  for (auto size : col_size_)
+    row_offset_.emplace_back(row_offset_.back() + size);
+  if (layout_ == kRowLayout) return;
+
+  // 每列的 NULL 位图在前，列值在后，起始地址按 8 字节对齐
+  col_offset_.push_back(0);
+  for (auto size : col_size_) {
+    int end = col_offset_.back() + bitmap_words_ * 8 + size * group_slots_;
+    col_offset_.emplace_back((end + 7) & ~7);
+  }
 }
 
 TableStore::~TableStore() {
-  for (auto tuple_group : tuple_groups_) free(tuple_group);
+  page_log_.reset();
+  unpinPage();
+  g_buffer_pool.dropFile(&file_);
 }
 
-bool TableStore::insertTuple(std::vector<Expr*>* values) {
-  if (free_list_.isEmpty())
-    if (newTupleGroup()) return true;
+bool TableStore::open(uint32_t file_id) {
+  if (group_slots_ == 0) {
+    std::cout << "[LiteDB-Error]  The row size " << tuple_size_
+              << " bytes exceeds the page size.\r\n";
+    return true;
+  }
 
-  Tuple* tup = free_list_.popHead();
-  data_list_.addHead(tup);
+  if (file_.open(DataFilePath(file_id, ".tbl"))) return true;
+  if (g_use_mmap) file_.enableMap();
+  if (string_heap_.open(file_id)) return true;
+  if (dict_encoding_ &&
+      dictionary_.open(DataFilePath(file_id, ".dic"), col_num_))
+    return true;
+  page_log_.setFile(file_id, kTableFile);
 
-  int idx = 0;
-  for (auto expr : *values) {
-    setColValue(tup, idx, expr);
-    idx++;
+  // 页按需读入缓冲池，这里只检查第一页的格式
+  group_cnt_ = file_.pageCount();
+  dirty_.resize(group_cnt_, false);
+  if (group_cnt_ > 0) {
+    Frame* frame = g_buffer_pool.fetchPage(&file_, 0);
+    if (frame == nullptr) return true;
+    TupleGroup* tuple_group = reinterpret_cast<TupleGroup*>(frame->data);
+    bool invalid = tuple_group->slot_cnt != group_slots_;
+    g_buffer_pool.unpinPage(frame);
+    if (invalid) {
+      std::cout << "[LiteDB-Error]  Invalid tuple group in " << file_.path()
+                << "\r\n";
+      return true;
+    }
   }
 
-  if (g_transaction.inTransaction()) g_transaction.addInsertUndo(this, tup);
+  file_id_ = file_id;
+  index_path_ = DataFilePath(file_id, ".idx");
 
+  // 空表不需要扫描就可以开始维护统计信息，立即写入文件，在第一次写入之前
+  // 崩溃也不会丢失
+  stats_path_ = DataFilePath(file_id, ".sta");
+  if (stats_.load(stats_path_, g_wal.recoveredLsn(file_id))) return true;
+  if (!stats_.analyzed() && group_cnt_ == 0) {
+    stats_.finish(0);
+    if (saveFiles()) return true;
+  }
   return false;
 }
 
-bool TableStore::deleteTuple(Tuple* tup) {
-  data_list_.delTuple(tup);
-  free_list_.addHead(tup);
-  if (g_transaction.inTransaction()) g_transaction.addDeleteUndo(this, tup);
+bool TableStore::saveFiles() {
+  return stats_.save(stats_path_, g_wal.activeTrxLsn()) || saveIndexes();
+}
 
-  return true;
+bool TableStore::flush() {
+  releasePages();
+  if (saveFiles()) return true;
+  if (dirty_groups_.empty()) return false;
+
+  // 先写字符串堆，保证数据文件中的引用都指向已经写入的字符串
+  if (string_heap_.flush()) return true;
+
+  for (auto group : dirty_groups_) {
+    if (g_buffer_pool.flushPage(&file_, group)) return true;
+    dirty_[group] = false;
+  }
+  dirty_groups_.clear();
+
+  return file_.sync();
+}
+
+void TableStore::releasePages() {
+  unpinPage();
+  string_heap_.unpinPage();
+}
+
+// 没有空闲页帧可以读入 tuple group 时返回 true
+bool TableStore::markDirty(size_t group) {
+  page(group, false, true);
+  if (frame_ == nullptr || page_log_.begin(frame_)) return true;
+
+  g_buffer_pool.markDirty(frame_);
+  if (!dirty_[group]) {
+    dirty_[group] = true;
+    dirty_groups_.emplace_back(group);
+  }
+  // 冻结的 tuple group 被修改时先解压，解压也记录在这次修改的日志中
+  if (isFrozen(group)) thawGroup(group);
+  return false;
+}
+
+uchar* TableStore::page(size_t group, bool sequential, bool write) {
+  if (frame_ != nullptr && frame_group_ == group)
+    return reinterpret_cast<uchar*>(frame_->data);
+  if (!write && mapped_page_ != nullptr && mapped_group_ == group)
+    return mapped_page_;
+
+  unpinPage();
+  // 缓冲池中的页可能比文件中的新，只有不在缓冲池中的页才能读映射
+  if (g_use_mmap && !write && !g_buffer_pool.contains(&file_, group)) {
+    const char* data = file_.mappedPage(group);
+    if (data != nullptr) {
+      mapped_page_ = reinterpret_cast<uchar*>(const_cast<char*>(data));
+      mapped_group_ = group;
+      return mapped_page_;
+    }
+  }
+
+  frame_ = g_buffer_pool.fetchPage(&file_, group, sequential);
+  if (frame_ == nullptr) {
+    // 读页失败时返回空的页，扫描时会跳过其中的行
+    static uchar empty_page[PAGE_SIZE];
+    memset(empty_page, 0, PAGE_SIZE);
+    return empty_page;
+  }
+
+  frame_group_ = group;
+  return reinterpret_cast<uchar*>(frame_->data);
 }
 
-void TableStore::removeTuple(Tuple* tup) {
-  data_list_.delTuple(tup);
-  free_list_.addHead(tup);
+void TableStore::unpinPage() {
+  mapped_page_ = nullptr;
+  if (frame_ == nullptr) return;
+  page_log_.end();
+  g_buffer_pool.unpinPage(frame_);
+  frame_ = nullptr;
 }
 
-void TableStore::recoverTuple(Tuple* tup) { data_list_.addHead(tup); }
+bool TableStore::insertTuple(std::vector<Expr*>* values) {
+  TupleId tid;
+  if (allocTuple(&tid)) return true;
+  if (markDirty(tid.group)) return true;
+  if (fillTuple(tid, values)) return true;
+  if (recoverTuple(tid)) {
+    freeTuple(tid);
+    return true;
+  }
 
-void TableStore::freeTuple(Tuple* tup) { free_list_.addHead(tup); }
+  if (g_transaction.recordingUndo()) g_transaction.addInsertUndo(this, tid);
+
+  return false;
+}
 
-bool TableStore::updateTuple(Tuple* tup, std::vector<size_t>& idxs,
+bool TableStore::insertBatch(const std::vector<std::vector<Expr*>*>& rows) {
+  if (reserveTuples(rows.size())) return true;
+
+  std::vector<TupleId> tids;
+  tids.reserve(rows.size());
+  for (auto values : rows) {
+    TupleId tid;
+    if (allocTuple(&tid)) {
+      for (auto inserted : tids) freeTuple(inserted);
+      return true;
+    }
+    if (markDirty(tid.group) || fillTuple(tid, values)) {
+      for (auto inserted : tids) freeTuple(inserted);
+      return true;
+    }
+    tids.emplace_back(tid);
+  }
+
+  // 整批写完后才对扫描可见。失败时释放还不可见的行，已经可见的行仍然
+  // 记录 undo
+  size_t visible = 0;
+  while (visible < tids.size() && !recoverTuple(tids[visible])) visible++;
+  bool err = visible < tids.size();
+  for (size_t i = visible; i < tids.size(); i++) freeTuple(tids[i]);
+  tids.resize(visible);
+
+  if (g_transaction.recordingUndo()) g_transaction.addInsertUndo(this, tids);
+
+  return err;
+}
+
+// 事务或语句中删除的行在提交前保留槽位，提交时由 freeTuple 释放
+bool TableStore::deleteTuple(TupleId tid) {
+  if (markDirty(tid.group)) return true;
+  updateStats(tid, -1);
+  updateIndexes(tid, -1);
+  TupleGroup* tuple_group = tupleGroup(tid.group);
+  tuple_group->live[tid.slot / 64] &= ~(1ULL << (tid.slot % 64));
+  if (g_transaction.recordingUndo()) {
+    g_transaction.addDeleteUndo(this, tid);
+    return false;
+  }
+  return freeTuple(tid);
+}
+
+bool TableStore::removeTuple(TupleId tid) {
+  if (markDirty(tid.group)) return true;
+  updateStats(tid, -1);
+  updateIndexes(tid, -1);
+  TupleGroup* tuple_group = tupleGroup(tid.group);
+  tuple_group->live[tid.slot / 64] &= ~(1ULL << (tid.slot % 64));
+  return freeTuple(tid);
+}
+
+bool TableStore::recoverTuple(TupleId tid) {
+  if (markDirty(tid.group)) return true;
+  TupleGroup* tuple_group = tupleGroup(tid.group);
+  tuple_group->live[tid.slot / 64] |= (1ULL << (tid.slot % 64));
+  updateStats(tid, 1);
+  updateIndexes(tid, 1);
+  return false;
+}
+
+bool TableStore::freeTuple(TupleId tid) {
+  if (markDirty(tid.group)) return true;
+
+  // 释放行引用的长字符串，NULL 标记恢复为空闲槽位的初始状态
+  for (int i = 0; i < col_num_; i++) {
+    if (!isColumnNull(tid, i)) {
+      if (isVarchar(i)) releaseVarchar(columnData(tid, i));
+    } else {
+      setColumnNull(tid, i, false);
+    }
+  }
+
+  TupleGroup* tuple_group = tupleGroup(tid.group);
+  tuple_group->used[tid.slot / 64] &= ~(1ULL << (tid.slot % 64));
+  tuple_group->used_cnt--;
+  if (tuple_group->used_cnt == 0) resetZoneMaps(tid.group);
+  if (tid.group < free_group_) free_group_ = tid.group;
+  return false;
+}
+
+bool TableStore::updateTuple(TupleId tid, std::vector<size_t>& idxs,
                              std::vector<Expr*>& values) {
-  if (g_transaction.inTransaction()) g_transaction.addUpdateUndo(this, tup);
+  if (markDirty(tid.group)) return true;
+  bool in_trx = g_transaction.recordingUndo();
+  if (in_trx) g_transaction.addUpdateUndo(this, tid);
 
-  for (size_t i = 0; i < idxs.size(); i++) {
+  // 失败时已经修改的列保留，由 undo 恢复，索引仍然要和行一致
+  updateIndexes(tid, -1, &idxs);
+  bool err = false;
+  for (size_t i = 0; i < idxs.size() && !err; i++) {
     size_t idx = idxs[i];
     Expr* expr = values[i];
-    setColValue(tup, idx, expr);
+
+    // 旧的字符串还被 undo 引用，提交时再释放
+    bool release = !in_trx && isVarchar(idx) && !isColumnNull(tid, idx);
+    VarcharSlot old;
+    if (release) memcpy(&old, columnData(tid, idx), sizeof(old));
+
+    updateColumnStats(tid, idx, -1);
+    err = setColValue(tid, idx, expr);
+    updateColumnStats(tid, idx, 1);
+    if (!err && release) releaseVarchar(reinterpret_cast<uchar*>(&old));
+  }
+  updateIndexes(tid, 1, &idxs);
+
+  return err;
+}
+
+bool TableStore::seqScan(TupleId& tid, bool* found) {
+  *found = false;
+  size_t slot = tid.slot;
+  for (size_t group = tid.group; group < group_cnt_; group++, slot = 0) {
+    uchar* data = page(group, true);
+    if (frame_ == nullptr && mapped_page_ == nullptr) return true;
+
+    TupleGroup* tuple_group = reinterpret_cast<TupleGroup*>(data);
+    for (size_t w = slot / 64; w < static_cast<size_t>(bitmap_words_); w++) {
+      uint64_t bits = tuple_group->live[w];
+      if (w == slot / 64) bits &= ~0ULL << (slot % 64);
+      if (bits == 0) continue;
+
+      tid.group = group;
+      tid.slot = w * 64 + __builtin_ctzll(bits);
+      *found = true;
+      return false;
+    }
   }
 
   return false;
 }
 
-Tuple* TableStore::seqScan(Tuple* tup) {
-  if (tup == nullptr)
-    return data_list_.getHead();
-  else
-    return data_list_.getNext(tup);
+bool TableStore::groupMayEqual(size_t group, size_t idx, Expr* val) {
+  TupleGroup* tuple_group = tupleGroup(group);
+  ZoneMap& zone_map = zoneMaps(group)[idx];
+  if (zone_map.null_cnt == tuple_group->used_cnt) return false;
+
+  switch ((*columns_)[idx]->type.data_type) {
+    case DataType::INT:
+    case DataType::LONG:
+      return (val->type == kExprLiteralInt && zone_map.min_ival <= val->ival &&
+              val->ival <= zone_map.max_ival);
+    case DataType::DOUBLE:
+      return (val->type == kExprLiteralFloat &&
+              zone_map.min_fval <= val->fval &&
+              val->fval <= zone_map.max_fval);
+    case DataType::CHAR: {
+      if (!isEncoded(idx)) return true;
+      uint32_t code;
+      return (lookupCode(idx, val, &code) && zone_map.min_ival <= code &&
+              code <= zone_map.max_ival);
+    }
+    default:
+      return true;
+  }
 }
 
-void TableStore::parseTuple(Tuple* tup, std::vector<Expr*>& values) {
-  bool* is_null = reinterpret_cast<bool*>(&tup->data[0]);
-  uchar* data = tup->data + columns_->size();
+bool TableStore::isColumnEqual(TupleId tid, size_t idx, Expr* val) {
+  if (isColumnNull(tid, idx)) return false;
 
-  for (size_t i = 0; i < columns_->size(); i++) {
-    Expr* e = nullptr;
-    if (is_null[i]) {
-      e = Expr::makeNullLiteral();
-      values.emplace_back(e);
-      continue;
+  uchar* data = columnData(tid, idx);
+  switch ((*columns_)[idx]->type.data_type) {
+    case DataType::INT:
+      return (val->type == kExprLiteralInt &&
+              *reinterpret_cast<int32_t*>(data) == val->ival);
+    case DataType::LONG:
+      return (val->type == kExprLiteralInt &&
+              *reinterpret_cast<int64_t*>(data) == val->ival);
+    case DataType::DOUBLE:
+      return (val->type == kExprLiteralFloat &&
+              *reinterpret_cast<double*>(data) == val->fval);
+    case DataType::CHAR: {
+      if (val->type != kExprLiteralString) return false;
+      if (!isEncoded(idx))
+        return (strcmp(reinterpret_cast<char*>(data), val->name) == 0);
+
+      uint32_t code;
+      return (dictionary_.lookup(idx, val->name, &code) &&
+              *reinterpret_cast<uint32_t*>(data) == code);
     }
+    case DataType::VARCHAR: {
+      if (val->type != kExprLiteralString) return false;
 
-    ColumnDefinition* col = (*columns_)[i];
-    int offset = col_offset_[i];
-    int size = col_offset_[i + 1] - col_offset_[i];
-    switch (col->type.data_type) {
-      case DataType::INT: {
-        int64_t val = *reinterpret_cast<int32_t*>(data + offset);
-        e = Expr::makeLiteral(val);
-        break;
-      }
-      case DataType::LONG: {
-        int64_t val = *reinterpret_cast<int64_t*>(data + offset);
-        e = Expr::makeLiteral(val);
-        break;
-      }
-      case DataType::DOUBLE: {
-        double val = *reinterpret_cast<double*>(data + offset);
-        e = Expr::makeLiteral(val);
-        break;
+      VarcharSlot slot;
+      memcpy(&slot, data, sizeof(slot));
+      size_t len = strlen(val->name);
+      if (slot.len != len) return false;
+      if (len <= VARCHAR_INLINE_SIZE)
+        return (memcmp(slot.data, val->name, len) == 0);
+
+      // 先比较行内的前缀，不相等时不用访问字符串堆
+      if (memcmp(slot.data, val->name, 4) != 0) return false;
+      uint64_t ref;
+      memcpy(&ref, slot.data + 4, sizeof(ref));
+      return (memcmp(string_heap_.getString(ref, len), val->name, len) == 0);
+    }
+    default:
+      return false;
+  }
+}
+
+bool TableStore::lookupCode(size_t idx, Expr* val, uint32_t* code) {
+  return (val->type == kExprLiteralString &&
+          dictionary_.lookup(idx, val->name, code));
+}
+
+void TableStore::copyTupleData(TupleId tid, uchar* buf) {
+  if (isRowGroup(tid.group)) {
+    memcpy(buf, groupData(tid.group) + tid.slot * tuple_size_, tuple_size_);
+    return;
+  }
+
+  bool* is_null = reinterpret_cast<bool*>(buf);
+  uchar* data = buf + col_num_;
+  for (int i = 0; i < col_num_; i++) {
+    is_null[i] = isColumnNull(tid, i);
+    memcpy(data, columnData(tid, i), col_size_[i]);
+    data += col_size_[i];
+  }
+}
+
+bool TableStore::restoreTupleData(TupleId tid, uchar* buf) {
+  if (markDirty(tid.group)) return true;
+  // 索引的键要在释放字符串之前计算
+  updateStats(tid, -1);
+  updateIndexes(tid, -1);
+
+  // 释放事务中新写入、回滚后不再被引用的长字符串
+  bool* old_null = reinterpret_cast<bool*>(buf);
+  uchar* old_data = buf + col_num_;
+  for (int i = 0; i < col_num_; i++) {
+    if (isVarchar(i) && !isColumnNull(tid, i)) {
+      uchar* ptr = columnData(tid, i);
+      if (old_null[i] || memcmp(ptr, old_data, sizeof(VarcharSlot)) != 0)
+        releaseVarchar(ptr);
+    }
+    old_data += col_size_[i];
+  }
+
+  // 恢复的值在修改前已经计入 zone map，只需要同步 NULL 标记
+  writeTupleData(tid, buf);
+  updateStats(tid, 1);
+  updateIndexes(tid, 1);
+  return false;
+}
+
+void TableStore::writeTupleData(TupleId tid, uchar* buf) {
+  bool* is_null = reinterpret_cast<bool*>(buf);
+  for (int i = 0; i < col_num_; i++) setColumnNull(tid, i, is_null[i]);
+
+  if (isRowGroup(tid.group)) {
+    memcpy(groupData(tid.group) + tid.slot * tuple_size_, buf, tuple_size_);
+    return;
+  }
+
+  uchar* data = buf + col_num_;
+  for (int i = 0; i < col_num_; i++) {
+    memcpy(columnData(tid, i), data, col_size_[i]);
+    data += col_size_[i];
+  }
+}
+
+// 从最后一个 tuple group 开始，把行逐个移动到最靠前的空闲槽位，直到空闲
+// 槽位都在被移动的 tuple group 之后。移空的 tuple group 都在文件末尾
+bool TableStore::compact(size_t* moved) {
+  std::vector<uchar> buf(tuple_size_);
+
+  // 提交之后、释放删除的行之前崩溃会留下已分配但不可见的槽位，先释放
+  for (size_t group = 0; group < group_cnt_; group++) {
+    for (int w = 0; w < bitmap_words_; w++) {
+      TupleGroup* tuple_group = tupleGroup(group);
+      uint64_t bits = tuple_group->used[w] & ~tuple_group->live[w];
+      if (w == bitmap_words_ - 1 && group_slots_ % 64 != 0)
+        bits &= (1ULL << (group_slots_ % 64)) - 1;
+      for (; bits != 0; bits &= bits - 1) {
+        TupleId tid = {static_cast<uint32_t>(group),
+                       static_cast<uint32_t>(w * 64 + __builtin_ctzll(bits))};
+        if (freeTuple(tid)) return true;
       }
-      case DataType::CHAR:
-      case DataType::VARCHAR: {
-        char* val = static_cast<char*>(malloc(size));
-        memcpy(val, (data + offset), size);
-        e = Expr::makeLiteral(val);
-        break;
+    }
+  }
+  free_group_ = 0;
+
+  for (size_t group = group_cnt_; group-- > 0;) {
+    for (int w = 0; w < bitmap_words_; w++) {
+      uint64_t bits = tupleGroup(group)->used[w];
+      if (w == bitmap_words_ - 1 && group_slots_ % 64 != 0)
+        bits &= (1ULL << (group_slots_ % 64)) - 1;
+
+      for (; bits != 0; bits &= bits - 1) {
+        while (free_group_ < group &&
+               tupleGroup(free_group_)->used_cnt == group_slots_)
+          free_group_++;
+        if (free_group_ >= group) return false;
+
+        TupleId from = {static_cast<uint32_t>(group),
+                        static_cast<uint32_t>(w * 64 + __builtin_ctzll(bits))};
+        TupleId to;
+        if (allocTuple(&to) || moveTuple(from, to, buf.data())) return true;
+        (*moved)++;
       }
-      default:
-        break;
     }
-    values.emplace_back(e);
   }
+
+  return false;
+}
+
+// 行的长字符串引用原样拷贝，字符串堆不变
+bool TableStore::moveTuple(TupleId from, TupleId to, uchar* buf) {
+  TupleGroup* tuple_group = tupleGroup(from.group);
+  uint64_t bit = 1ULL << (from.slot % 64);
+  bool live = tuple_group->live[from.slot / 64] & bit;
+  if (live) updateIndexes(from, -1);
+  copyTupleData(from, buf);
+
+  if (markDirty(to.group)) return true;
+  writeTupleData(to, buf);
+  for (int i = 0; i < col_num_; i++)
+    if (!isColumnNull(to, i)) widenZoneMap(to, i);
+  // 移动不改变统计信息，索引中行的位置要更新
+  if (live) {
+    tupleGroup(to.group)->live[to.slot / 64] |= 1ULL << (to.slot % 64);
+    updateIndexes(to, 1);
+  }
+
+  // 槽位恢复为空闲状态，但不释放字符串
+  if (markDirty(from.group)) return true;
+  for (int i = 0; i < col_num_; i++) setColumnNull(from, i, false);
+  tuple_group = tupleGroup(from.group);
+  tuple_group->live[from.slot / 64] &= ~bit;
+  tuple_group->used[from.slot / 64] &= ~bit;
+  tuple_group->used_cnt--;
+  if (tuple_group->used_cnt == 0) resetZoneMaps(from.group);
+  return false;
+}
+
+bool TableStore::shrink(size_t* freed) {
+  releasePages();
+
+  size_t cnt = group_cnt_;
+  while (cnt > 0) {
+    uchar* data = page(cnt - 1);
+    if (frame_ == nullptr && mapped_page_ == nullptr) return true;
+    if (reinterpret_cast<TupleGroup*>(data)->used_cnt != 0) break;
+    cnt--;
+  }
+  unpinPage();
+
+  if (cnt < group_cnt_) {
+    for (size_t i = cnt; i < group_cnt_; i++)
+      g_buffer_pool.discardPage(&file_, i);
+    if (file_.truncate(cnt)) return true;
+
+    *freed += group_cnt_ - cnt;
+    group_cnt_ = cnt;
+    dirty_.resize(cnt);
+    if (free_group_ > cnt) free_group_ = cnt;
+  }
+
+  return string_heap_.shrink(freed);
+}
+
+bool TableStore::releaseTupleData(TupleId tid, uchar* buf) {
+  if (markDirty(tid.group)) return true;
+  bool* is_null = reinterpret_cast<bool*>(buf);
+  uchar* data = buf + col_num_;
+  for (int i = 0; i < col_num_; i++) {
+    if (isVarchar(i) && !is_null[i] &&
+        (isColumnNull(tid, i) ||
+         memcmp(columnData(tid, i), data, sizeof(VarcharSlot)) != 0))
+      releaseVarchar(data);
+    data += col_size_[i];
+  }
+  return false;
 }
 
 bool TableStore::newTupleGroup() {
-  Tuple* tuple_group =
-      static_cast<Tuple*>(malloc(tuple_size_ * TUPLE_GROUP_SIZE));
-  memset(tuple_group, 0, (tuple_size_ * TUPLE_GROUP_SIZE));
-  if (tuple_group == nullptr) {
-    std::cout << "[LiteDB-Error]  Failed to malloc "
-              << tuple_size_ * TUPLE_GROUP_SIZE << " bytes";
-    return true;
+  unpinPage();
+  frame_ = g_buffer_pool.newPage(&file_, group_cnt_);
+  if (frame_ == nullptr) return true;
+
+  frame_group_ = group_cnt_++;
+  dirty_.emplace_back(false);
+  if (page_log_.begin(frame_, true) || markDirty(frame_group_)) return true;
+
+  TupleGroup* tuple_group = tupleGroup(frame_group_);
+  tuple_group->slot_cnt = group_slots_;
+  if (layout_ == kHybridLayout) tuple_group->flags = TUPLE_GROUP_DELTA;
+
+  // 位图末尾超出槽位数的位永远不可分配
+  for (int i = group_slots_; i < TUPLE_GROUP_MAX_SLOTS; i++)
+    tuple_group->used[i / 64] |= (1ULL << (i % 64));
+
+  resetZoneMaps(frame_group_);
+  return false;
+}
+
+void TableStore::resetZoneMaps(size_t group) {
+  ZoneMap* zone_maps = zoneMaps(group);
+  for (int i = 0; i < col_num_; i++) {
+    ZoneMap& zone_map = zone_maps[i];
+    zone_map.null_cnt = 0;
+    zone_map.min_ival = std::numeric_limits<int64_t>::max();
+    zone_map.max_ival = std::numeric_limits<int64_t>::min();
+    zone_map.min_fval = std::numeric_limits<double>::infinity();
+    zone_map.max_fval = -std::numeric_limits<double>::infinity();
+  }
+}
+
+void TableStore::widenZoneMap(TupleId tid, size_t idx) {
+  ZoneMap& zone_map = zoneMaps(tid.group)[idx];
+  uchar* data = columnData(tid, idx);
+  switch ((*columns_)[idx]->type.data_type) {
+    case DataType::INT:
+    case DataType::LONG: {
+      int64_t val = (col_size_[idx] == 4) ? *reinterpret_cast<int32_t*>(data)
+                                          : *reinterpret_cast<int64_t*>(data);
+      if (val < zone_map.min_ival) zone_map.min_ival = val;
+      if (val > zone_map.max_ival) zone_map.max_ival = val;
+      break;
+    }
+    case DataType::DOUBLE: {
+      double val = *reinterpret_cast<double*>(data);
+      if (val < zone_map.min_fval) zone_map.min_fval = val;
+      if (val > zone_map.max_fval) zone_map.max_fval = val;
+      break;
+    }
+    case DataType::CHAR: {
+      // 字典编码的列记录编码的范围
+      if (!isEncoded(idx)) break;
+      int64_t val = *reinterpret_cast<uint32_t*>(data);
+      if (val < zone_map.min_ival) zone_map.min_ival = val;
+      if (val > zone_map.max_ival) zone_map.max_ival = val;
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+// 预先分配足够的 tuple group，保证之后的 cnt 次 allocTuple 不用再分配内存
+bool TableStore::reserveTuples(size_t cnt) {
+  size_t free_cnt = 0;
+  for (size_t i = free_group_; i < group_cnt_; i++)
+    free_cnt += group_slots_ - tupleGroup(i)->used_cnt;
+
+  while (free_cnt < cnt) {
+    if (newTupleGroup()) return true;
+    free_cnt += group_slots_;
+  }
+
+  return false;
+}
+
+bool TableStore::allocTuple(TupleId* tid) {
+  while (free_group_ < group_cnt_ &&
+         tupleGroup(free_group_)->used_cnt == group_slots_)
+    free_group_++;
+
+  if (free_group_ == group_cnt_)
+    if (newTupleGroup()) return true;
+
+  if (markDirty(free_group_)) return true;
+  TupleGroup* tuple_group = tupleGroup(free_group_);
+  for (int w = 0; w < bitmap_words_; w++) {
+    uint64_t bits = ~tuple_group->used[w];
+    if (bits == 0) continue;
+
+    int slot = w * 64 + __builtin_ctzll(bits);
+    tuple_group->used[w] |= (1ULL << (slot % 64));
+    tuple_group->used_cnt++;
+    if (tuple_group->used_cnt == group_slots_ &&
+        layout_ == kHybridLayout && isRowGroup(free_group_))
+      full_deltas_.emplace_back(free_group_);
+    tid->group = free_group_;
+    tid->slot = slot;
+    return false;
   }
 
-  tuple_groups_.emplace_back(tuple_group);
-  uchar* ptr = reinterpret_cast<uchar*>(tuple_group);
-  for (int i = 0; i < TUPLE_GROUP_SIZE; i++) {
-    Tuple* tup = reinterpret_cast<Tuple*>(ptr);
-    free_list_.addHead(tup);
-    ptr += tuple_size_;
+  return true;
+}
+
+bool TableStore::fillTuple(TupleId tid, std::vector<Expr*>* values) {
+  int idx = 0;
+  for (auto expr : *values) {
+    if (setColValue(tid, idx, expr)) {
+      // 还未写入的列置为 NULL，释放槽位时不会误释放字符串
+      for (; idx < col_num_; idx++) setColumnNull(tid, idx, true);
+      freeTuple(tid);
+      return true;
+    }
+    idx++;
   }
 
   return false;
 }
 
-void TableStore::setColValue(Tuple* tup, int idx, Expr* expr) {
-  bool* is_null = reinterpret_cast<bool*>(&tup->data[0]);
-  uchar* data = tup->data + col_num_;
-  int offset = col_offset_[idx];
-  int size = col_offset_[idx + 1] - col_offset_[idx];
-  uchar* ptr = &data[offset];
-  is_null[idx] = false;
+bool TableStore::setColValue(TupleId tid, int idx, Expr* expr) {
+  int size = col_size_[idx];
+  uchar* ptr = columnData(tid, idx);
+  setColumnNull(tid, idx, false);
 
   switch (expr->type) {
     case kExprLiteralInt: {
@@ -180,17 +766,775 @@ void TableStore::setColValue(Tuple* tup, int idx, Expr* expr) {
     }
     case kExprLiteralString: {
       int len = strlen(expr->name);
-      memcpy(ptr, expr->name, len);
-      ptr[len] = '\0';
+      if (isEncoded(idx)) {
+        uint32_t code;
+        if (dictionary_.encode(idx, expr->name, &code)) return true;
+        *reinterpret_cast<uint32_t*>(ptr) = code;
+        break;
+      }
+      if (!isVarchar(idx)) {
+        memcpy(ptr, expr->name, len);
+        ptr[len] = '\0';
+        break;
+      }
+
+      VarcharSlot slot;
+      slot.len = len;
+      if (len <= VARCHAR_INLINE_SIZE) {
+        memcpy(slot.data, expr->name, len);
+      } else {
+        uint64_t ref;
+        if (string_heap_.addString(expr->name, len, &ref)) return true;
+        memcpy(slot.data, expr->name, 4);
+        memcpy(slot.data + 4, &ref, sizeof(ref));
+      }
+      memcpy(ptr, &slot, sizeof(slot));
       break;
     }
     case kExprLiteralNull: {
-      is_null[idx] = true;
+      setColumnNull(tid, idx, true);
+      return false;
+    }
+    default:
+      break;
+  }
+
+  widenZoneMap(tid, idx);
+  return false;
+}
+
+const char* TableStore::getChar(TupleId tid, size_t idx) {
+  uchar* data = columnData(tid, idx);
+  if (isEncoded(idx))
+    return dictionary_.decode(idx, *reinterpret_cast<uint32_t*>(data));
+  return reinterpret_cast<char*>(data);
+}
+
+const char* TableStore::getVarchar(uchar* ptr, uint32_t* len) {
+  VarcharSlot* slot = reinterpret_cast<VarcharSlot*>(ptr);
+  memcpy(len, &slot->len, sizeof(*len));
+  if (*len <= VARCHAR_INLINE_SIZE) return slot->data;
+
+  uint64_t ref;
+  memcpy(&ref, slot->data + 4, sizeof(ref));
+  return string_heap_.getString(ref, *len);
+}
+
+void TableStore::releaseVarchar(uchar* ptr) {
+  VarcharSlot slot;
+  memcpy(&slot, ptr, sizeof(slot));
+  if (slot.len <= VARCHAR_INLINE_SIZE) return;
+
+  uint64_t ref;
+  memcpy(&ref, slot.data + 4, sizeof(ref));
+  string_heap_.releaseString(ref, slot.len);
+}
+
+bool TableStore::isColumnNull(TupleId tid, size_t idx) {
+  uchar* data = groupData(tid.group);
+  if (isRowGroup(tid.group)) {
+    bool* is_null = reinterpret_cast<bool*>(data + tid.slot * tuple_size_);
+    return is_null[idx];
+  }
+
+  uint64_t* null_map = nullMap(tid.group, idx);
+  return (null_map[tid.slot / 64] >> (tid.slot % 64)) & 1;
+}
+
+void TableStore::setColumnNull(TupleId tid, size_t idx, bool is_null) {
+  if (isColumnNull(tid, idx) == is_null) return;
+  zoneMaps(tid.group)[idx].null_cnt += is_null ? 1 : -1;
+
+  uchar* data = groupData(tid.group);
+  if (isRowGroup(tid.group)) {
+    reinterpret_cast<bool*>(data + tid.slot * tuple_size_)[idx] = is_null;
+    return;
+  }
+
+  uint64_t* null_map = nullMap(tid.group, idx);
+  if (is_null)
+    null_map[tid.slot / 64] |= (1ULL << (tid.slot % 64));
+  else
+    null_map[tid.slot / 64] &= ~(1ULL << (tid.slot % 64));
+}
+
+uint64_t* TableStore::nullMap(size_t group, size_t idx) {
+  uchar* data = groupData(group);
+  int offset = isFrozen(group) ? encodedColumns(group)[idx].offset
+                               : col_offset_[idx];
+  return reinterpret_cast<uint64_t*>(data + offset);
+}
+
+uchar* TableStore::columnData(TupleId tid, size_t idx) {
+  uchar* data = groupData(tid.group);
+  if (isRowGroup(tid.group))
+    return data + tid.slot * tuple_size_ + col_num_ + row_offset_[idx];
+
+  if (!isFrozen(tid.group))
+    return data + col_offset_[idx] + bitmap_words_ * 8 +
+           tid.slot * col_size_[idx];
+
+  // 冻结的 tuple group 中压缩的列解码到 decoded_ 中返回，只能读取
+  const EncodedColumn& col = encodedColumns(tid.group)[idx];
+  uchar* values = data + col.offset + bitmap_words_ * 8;
+  if (col.encoding == kPlainEncoding) return values + tid.slot * col_size_[idx];
+
+  decoded_[idx] = DecodeValue(reinterpret_cast<char*>(values), col, tid.slot);
+  return reinterpret_cast<uchar*>(&decoded_[idx]);
+}
+
+// 可以压缩的列：INT/LONG 列和字典编码的 CHAR 列
+bool TableStore::isCompressible(size_t idx) {
+  DataType type = (*columns_)[idx]->type.data_type;
+  return type == DataType::INT || type == DataType::LONG || isEncoded(idx);
+}
+
+// 只冻结写满的 tuple group，还有空闲槽位的 tuple group 很快会被插入修改
+bool TableStore::freeze(size_t* frozen) {
+  if (layout_ == kRowLayout) return false;
+
+  for (size_t group = 0; group < group_cnt_; group++) {
+    if (isRowGroup(group) || isFrozen(group) ||
+        tupleGroup(group)->used_cnt != group_slots_)
+      continue;
+
+    bool done;
+    if (freezeGroup(group, &done)) return true;
+    if (done) (*frozen)++;
+  }
+
+  return false;
+}
+
+// 冻结之后页内行数据的开头是每列的 EncodedColumn，之后依次是每列的 NULL
+// 位图和列值。可以压缩的列按 ChooseEncoding 选择的编码保存，其他列原样
+// 拷贝。页的末尾至少空出一个磁盘块时才冻结，空出的部分写回时不占用磁盘
+// 空间
+bool TableStore::freezeGroup(size_t group, bool* done) {
+  *done = false;
+  size_t avail = PAGE_SIZE - data_offset_;
+  size_t bitmap_size = bitmap_words_ * 8;
+  std::vector<char> buf(avail, 0);
+  std::vector<int64_t> values(group_slots_);
+  EncodedColumn* cols = reinterpret_cast<EncodedColumn*>(buf.data());
+  size_t end = col_num_ * sizeof(EncodedColumn);
+
+  for (int i = 0; i < col_num_; i++) {
+    uchar* block = groupData(group) + col_offset_[i];
+    size_t plain_size = col_size_[i] * group_slots_;
+    size_t size = plain_size;
+    ChooseEncoding(nullptr, 0, plain_size, &cols[i]);
+    if (isCompressible(i)) {
+      collectValues(group, i, values.data());
+      size = ChooseEncoding(values.data(), group_slots_, plain_size, &cols[i]);
+    }
+
+    cols[i].offset = end;
+    if (end + bitmap_size + size > avail) return false;
+    memcpy(buf.data() + end, block, bitmap_size);
+    end += bitmap_size;
+    if (cols[i].encoding == kPlainEncoding)
+      memcpy(buf.data() + end, block + bitmap_size, size);
+    else
+      EncodeValues(values.data(), group_slots_, cols[i], buf.data() + end);
+    end = (end + size + 7) & ~static_cast<size_t>(7);
+  }
+
+  size_t blocks = (data_offset_ + end + DISK_BLOCK_SIZE - 1) / DISK_BLOCK_SIZE;
+  size_t old_end = data_offset_ + col_offset_.back();
+  size_t old_blocks = (old_end + DISK_BLOCK_SIZE - 1) / DISK_BLOCK_SIZE;
+  if (blocks >= old_blocks) return false;
+
+  if (markDirty(group)) return true;
+  memcpy(groupData(group), buf.data(), avail);
+  tupleGroup(group)->flags |= TUPLE_GROUP_FROZEN;
+  *done = true;
+  return false;
+}
+
+// 读出第 idx 列所有槽位的值。NULL 的值没有意义，用前一个不是 NULL 的值
+// 代替，不会扩大值的范围或增加 RLE 的段数
+void TableStore::collectValues(size_t group, size_t idx, int64_t* values) {
+  // 开头的 NULL 用第一个不是 NULL 的值代替
+  int first = 0;
+  while (first < group_slots_ &&
+         isColumnNull({static_cast<uint32_t>(group),
+                       static_cast<uint32_t>(first)}, idx))
+    first++;
+
+  int64_t prev = 0;
+  for (int i = 0; i < group_slots_; i++) {
+    int slot = (i == 0 && first < group_slots_) ? first : i;
+    TupleId tid = {static_cast<uint32_t>(group), static_cast<uint32_t>(slot)};
+    if (!isColumnNull(tid, idx)) {
+      uchar* data = columnData(tid, idx);
+      if (col_size_[idx] == 8)
+        prev = *reinterpret_cast<int64_t*>(data);
+      else if (isEncoded(idx))
+        prev = *reinterpret_cast<uint32_t*>(data);
+      else
+        prev = *reinterpret_cast<int32_t*>(data);
+    }
+    values[i] = prev;
+  }
+}
+
+// 把冻结的 tuple group 恢复成普通的 PAX 布局，调用前页已经标记为脏页
+void TableStore::thawGroup(size_t group) {
+  size_t avail = PAGE_SIZE - data_offset_;
+  size_t bitmap_size = bitmap_words_ * 8;
+  uchar* data = groupData(group);
+  std::vector<char> buf(data, data + avail);
+  const EncodedColumn* cols = reinterpret_cast<EncodedColumn*>(buf.data());
+  memset(data, 0, avail);
+
+  for (int i = 0; i < col_num_; i++) {
+    const char* src = buf.data() + cols[i].offset;
+    uchar* dst = data + col_offset_[i];
+    memcpy(dst, src, bitmap_size);
+    src += bitmap_size;
+    dst += bitmap_size;
+    if (cols[i].encoding == kPlainEncoding) {
+      memcpy(dst, src, col_size_[i] * group_slots_);
+      continue;
+    }
+
+    for (int slot = 0; slot < group_slots_; slot++) {
+      int64_t val = DecodeValue(src, cols[i], slot);
+      if (col_size_[i] == 8)
+        reinterpret_cast<int64_t*>(dst)[slot] = val;
+      else
+        reinterpret_cast<uint32_t*>(dst)[slot] = static_cast<uint32_t>(val);
+    }
+  }
+
+  tupleGroup(group)->flags &= ~TUPLE_GROUP_FROZEN;
+}
+
+bool TableStore::merge(bool all, size_t* merged) {
+  if (layout_ != kHybridLayout) return false;
+
+  std::vector<uint32_t> groups;
+  if (all) {
+    for (size_t group = 0; group < group_cnt_; group++)
+      if (tupleGroup(group)->used_cnt == group_slots_)
+        groups.emplace_back(group);
+  } else {
+    groups.swap(full_deltas_);
+  }
+
+  // 记录的 tuple group 可能已经被合并、删除了行或者被 VACUUM 截掉
+  for (auto group : groups) {
+    if (group >= group_cnt_ || !isRowGroup(group) ||
+        tupleGroup(group)->used_cnt != group_slots_)
+      continue;
+    if (mergeGroup(group)) return true;
+    (*merged)++;
+  }
+  full_deltas_.clear();
+
+  return false;
+}
+
+// 把行式存放的 tuple group 改写成 PAX 布局。空闲槽位也一起转换，NULL 标记
+// 保持空闲槽位的初始状态
+bool TableStore::mergeGroup(size_t group) {
+  if (markDirty(group)) return true;
+
+  size_t avail = PAGE_SIZE - data_offset_;
+  uchar* data = groupData(group);
+  std::vector<uchar> rows(data, data + avail);
+  memset(data, 0, avail);
+  tupleGroup(group)->flags &= ~TUPLE_GROUP_DELTA;
+
+  for (int slot = 0; slot < group_slots_; slot++) {
+    TupleId tid = {static_cast<uint32_t>(group), static_cast<uint32_t>(slot)};
+    uchar* row = rows.data() + slot * tuple_size_;
+    bool* is_null = reinterpret_cast<bool*>(row);
+    for (int i = 0; i < col_num_; i++) {
+      if (is_null[i]) nullMap(group, i)[slot / 64] |= 1ULL << (slot % 64);
+      memcpy(columnData(tid, i), row + col_num_ + row_offset_[i],
+             col_size_[i]);
+    }
+  }
+
+  return false;
+}
+
+// 事务中删除的行在提交之前仍然占用槽位，行数按 live 位统计，空闲空间按
+// 占用的槽位统计
+bool TableStore::status(TableStatus* status) {
+  size_t live_cnt = 0;
+  size_t used_cnt = 0;
+  for (size_t group = 0; group < group_cnt_; group++) {
+    uchar* data = page(group, true);
+    if (frame_ == nullptr && mapped_page_ == nullptr) return true;
+    TupleGroup* tuple_group = reinterpret_cast<TupleGroup*>(data);
+    used_cnt += tuple_group->used_cnt;
+    for (int w = 0; w < TUPLE_GROUP_BITMAP_WORDS; w++)
+      live_cnt += __builtin_popcountll(tuple_group->live[w]);
+  }
+  unpinPage();
+
+  DiskFile* heap_file = string_heap_.file();
+  status->rows = live_cnt;
+  status->groups = group_cnt_;
+  status->data_bytes = group_cnt_ * PAGE_SIZE;
+  status->free_bytes = (group_cnt_ * group_slots_ - used_cnt) * tuple_size_;
+  status->string_bytes = string_heap_.pageCount() * PAGE_SIZE;
+  status->dict_bytes = dictionary_.size();
+  status->index_bytes = 0;
+  for (auto index : indexes_)
+    status->index_bytes += (index->type == kHashIndex)
+                               ? index->hash.memoryBytes()
+                               : index->tree.memoryBytes();
+  status->cached_bytes = (g_buffer_pool.residentPages(&file_) +
+                          g_buffer_pool.residentPages(heap_file)) *
+                         PAGE_SIZE;
+  status->disk_bytes =
+      file_.diskBytes() + heap_file->diskBytes() + dictionary_.size();
+  return false;
+}
+
+uint64_t TableStore::columnHash(TupleId tid, size_t idx, double* val,
+                                bool* numeric) {
+  uchar* data = columnData(tid, idx);
+  *numeric = true;
+  switch ((*columns_)[idx]->type.data_type) {
+    case DataType::INT:
+    case DataType::LONG: {
+      // INT 和 LONG 按 int64_t 计算哈希
+      int64_t ival = (col_size_[idx] == 4) ? *reinterpret_cast<int32_t*>(data)
+                                           : *reinterpret_cast<int64_t*>(data);
+      *val = ival;
+      return StatsHash(&ival, sizeof(ival));
+    }
+    case DataType::DOUBLE:
+      *val = *reinterpret_cast<double*>(data);
+      return StatsHash(val, sizeof(*val));
+    case DataType::CHAR: {
+      *numeric = false;
+      const char* str = getChar(tid, idx);
+      return StatsHash(str, strlen(str));
+    }
+    case DataType::VARCHAR: {
+      *numeric = false;
+      uint32_t len;
+      const char* str = getVarchar(data, &len);
+      return StatsHash(str, len);
+    }
+    default:
+      *numeric = false;
+      return 0;
+  }
+}
+
+void TableStore::updateColumnStats(TupleId tid, size_t idx, int delta) {
+  if (!stats_.analyzed()) return;
+
+  if (isColumnNull(tid, idx)) {
+    stats_.addNull(idx, delta);
+    return;
+  }
+  double val;
+  bool numeric;
+  uint64_t hash = columnHash(tid, idx, &val, &numeric);
+  stats_.addValue(idx, hash, numeric ? &val : nullptr, delta);
+}
+
+void TableStore::updateStats(TupleId tid, int delta) {
+  if (!stats_.analyzed()) return;
+
+  stats_.addRow(delta);
+  for (int i = 0; i < col_num_; i++) updateColumnStats(tid, i, delta);
+}
+
+bool TableStore::analyze() {
+  stats_.reset();
+  int64_t row_cnt = 0;
+  TupleId tid = {0, 0};
+  bool found;
+  while (true) {
+    if (seqScan(tid, &found)) return true;
+    if (!found) break;
+
+    row_cnt++;
+    for (int i = 0; i < col_num_; i++) {
+      if (isColumnNull(tid, i)) {
+        stats_.sampleNull(i);
+        continue;
+      }
+      double val;
+      bool numeric;
+      uint64_t hash = columnHash(tid, i, &val, &numeric);
+      stats_.sample(i, hash, numeric ? &val : nullptr);
+    }
+    tid.slot++;
+  }
+  stats_.finish(row_cnt);
+  releasePages();
+
+  return saveFiles();
+}
+
+// B+ 树先收集所有的键排序，再自底向上批量构建，比逐行插入快并且节点更满
+bool TableStore::addIndex(TableIndex* index) {
+  index->tree.clear();
+  index->hash.clear();
+  std::vector<std::pair<std::string, uint64_t>> entries;
+  std::string key;
+  TupleId tid = {0, 0};
+  bool found;
+  while (true) {
+    if (seqScan(tid, &found)) return true;
+    if (!found) break;
+
+    if (index->type == kHashIndex) {
+      updateIndex(index, tid, 1);
+    } else {
+      indexKey(tid, index, &key);
+      entries.emplace_back(key, PackTupleId(tid));
+    }
+    tid.slot++;
+  }
+  releasePages();
+
+  // 键的最后是行号，不会重复
+  std::sort(entries.begin(), entries.end());
+  index->tree.bulkLoad(&entries, g_index_fill_factor);
+  indexes_.emplace_back(index);
+  invalidateIndexFile();
+  return false;
+}
+
+void TableStore::removeIndex(TableIndex* index) {
+  auto iter = std::find(indexes_.begin(), indexes_.end(), index);
+  if (iter != indexes_.end()) indexes_.erase(iter);
+  invalidateIndexFile();
+}
+
+bool TableStore::openIndexes(const std::vector<TableIndex*>& indexes) {
+  std::vector<bool> loaded(indexes.size(), false);
+  if (g_persist_indexes) {
+    loadIndexes(indexes, &loaded);
+  } else if (unlink(index_path_.c_str()) == 0) {
+    // 没有开启时不维护文件，留下的文件之后可能和数据不一致
+    std::cout << "[LiteDB-Info]  Remove index file " << index_path_
+              << "\r\n";
+  }
+
+  for (size_t i = 0; i < indexes.size(); i++) {
+    if (loaded[i])
+      indexes_.emplace_back(indexes[i]);
+    else if (addIndex(indexes[i]))
+      return true;
+  }
+  return false;
+}
+
+void TableStore::loadIndexes(const std::vector<TableIndex*>& indexes,
+                             std::vector<bool>* loaded) {
+  FILE* file = fopen(index_path_.c_str(), "r");
+  if (file == nullptr) return;
+
+  uint32_t header[2];
+  uint64_t lsn;
+  uint32_t index_cnt;
+  bool ok = fread(header, sizeof(header), 1, file) == 1 &&
+            header[0] == INDEX_FILE_MAGIC &&
+            header[1] == INDEX_FILE_VERSION &&
+            fread(&lsn, sizeof(lsn), 1, file) == 1 &&
+            g_wal.recoveredLsn(file_id_) < lsn &&
+            fread(&index_cnt, sizeof(index_cnt), 1, file) == 1;
+  std::string key;
+  for (uint32_t i = 0; ok && i < index_cnt; i++) {
+    uint8_t type;
+    uint32_t col_cnt;
+    ok = fread(&type, sizeof(type), 1, file) == 1 &&
+         fread(&col_cnt, sizeof(col_cnt), 1, file) == 1 &&
+         col_cnt <= static_cast<uint32_t>(col_num_);
+    std::vector<size_t> cols;
+    for (uint32_t j = 0; ok && j < col_cnt; j++) {
+      uint32_t col;
+      ok = fread(&col, sizeof(col), 1, file) == 1;
+      cols.emplace_back(col);
+    }
+    uint64_t entry_cnt;
+    ok = ok && fread(&entry_cnt, sizeof(entry_cnt), 1, file) == 1;
+    if (!ok) break;
+
+    // 类型和列都相同的索引，没有时读过这一段
+    TableIndex* index = nullptr;
+    for (size_t j = 0; j < indexes.size(); j++) {
+      if ((*loaded)[j] || indexes[j]->type != type ||
+          indexes[j]->cols != cols)
+        continue;
+      index = indexes[j];
+      (*loaded)[j] = true;
+      break;
+    }
+    if (index != nullptr) index->hash.clear();
+
+    // B+ 树的项按键的顺序写入，读完之后批量构建
+    std::vector<std::pair<std::string, uint64_t>> entries;
+    for (uint64_t j = 0; ok && j < entry_cnt; j++) {
+      uint32_t len;
+      uint64_t value;
+      ok = fread(&len, sizeof(len), 1, file) == 1 &&
+           len <= INDEX_FILE_MAX_KEY;
+      if (!ok) break;
+      key.resize(len);
+      ok = (len == 0 || fread(&key[0], len, 1, file) == 1) &&
+           fread(&value, sizeof(value), 1, file) == 1;
+      if (!ok || index == nullptr) continue;
+      if (index->type == kHashIndex) {
+        index->hash.insert(key, value);
+      } else {
+        ok = entries.empty() || entries.back().first < key;
+        entries.emplace_back(key, value);
+      }
+    }
+    if (ok && index != nullptr && index->type == kBTreeIndex)
+      index->tree.bulkLoad(&entries, g_index_fill_factor);
+  }
+  fclose(file);
+
+  // 文件不完整或者恢复时重放了写入文件之后的修改时扫描构建所有的索引
+  if (!ok) {
+    std::cout << "[LiteDB-Info]  Ignore invalid index file " << index_path_
+              << "\r\n";
+    loaded->assign(indexes.size(), false);
+    unlink(index_path_.c_str());
+    return;
+  }
+  index_file_valid_ = true;
+}
+
+bool TableStore::saveIndexes() {
+  if (!g_persist_indexes || index_file_valid_ || indexes_.empty())
+    return false;
+  // 有未提交的事务时，内存中的索引包含恢复时会回滚的修改
+  uint64_t lsn = g_wal.nextLsn();
+  if (g_wal.activeTrxLsn() != lsn) return false;
+
+  std::string tmp_path = index_path_ + ".tmp";
+  FILE* file = fopen(tmp_path.c_str(), "w");
+  if (file == nullptr) {
+    std::cout << "[LiteDB-Error]  Failed to open " << tmp_path << ": "
+              << strerror(errno) << "\r\n";
+    return true;
+  }
+
+  auto write_entry = [file](const std::string& key, uint64_t value) {
+    uint32_t len = key.size();
+    fwrite(&len, sizeof(len), 1, file);
+    fwrite(key.data(), 1, len, file);
+    fwrite(&value, sizeof(value), 1, file);
+  };
+  uint32_t header[2] = {INDEX_FILE_MAGIC, INDEX_FILE_VERSION};
+  uint32_t index_cnt = indexes_.size();
+  fwrite(header, sizeof(header), 1, file);
+  fwrite(&lsn, sizeof(lsn), 1, file);
+  fwrite(&index_cnt, sizeof(index_cnt), 1, file);
+  for (auto index : indexes_) {
+    uint8_t type = index->type;
+    uint32_t col_cnt = index->cols.size();
+    fwrite(&type, sizeof(type), 1, file);
+    fwrite(&col_cnt, sizeof(col_cnt), 1, file);
+    for (auto idx : index->cols) {
+      uint32_t col = idx;
+      fwrite(&col, sizeof(col), 1, file);
+    }
+    uint64_t entry_cnt = (index->type == kHashIndex) ? index->hash.size()
+                                                     : index->tree.size();
+    fwrite(&entry_cnt, sizeof(entry_cnt), 1, file);
+    if (index->type == kHashIndex) {
+      index->hash.forEach(write_entry);
+    } else {
+      for (auto it = index->tree.begin(); it.valid(); it.next())
+        write_entry(it.key(), it.value());
+    }
+  }
+
+  bool err = (ferror(file) || fflush(file) != 0 || fsync(fileno(file)) != 0);
+  err = (fclose(file) != 0) || err;
+  if (err || rename(tmp_path.c_str(), index_path_.c_str()) != 0) {
+    std::cout << "[LiteDB-Error]  Failed to write " << index_path_ << ": "
+              << strerror(errno) << "\r\n";
+    return true;
+  }
+
+  index_file_valid_ = true;
+  return false;
+}
+
+// 删除要落盘，否则崩溃之后旧文件可能重新出现，而日志已经在检查点截断，
+// 恢复时发现不了文件已经过期
+void TableStore::invalidateIndexFile() {
+  if (!index_file_valid_) return;
+
+  index_file_valid_ = false;
+  int dir = ::open(g_data_dir.c_str(), O_RDONLY);
+  if (unlink(index_path_.c_str()) != 0 || dir < 0 || fsync(dir) != 0)
+    std::cout << "[LiteDB-Error]  Failed to remove " << index_path_ << ": "
+              << strerror(errno) << "\r\n";
+  if (dir >= 0) ::close(dir);
+}
+
+void TableStore::indexKey(TupleId tid, TableIndex* index, std::string* key) {
+  key->clear();
+  for (auto idx : index->cols) columnKey(tid, idx, key);
+  if (index->type == kBTreeIndex) EncodeKeyUint64(PackTupleId(tid), key);
+}
+
+void TableStore::columnKey(TupleId tid, size_t idx, std::string* key) {
+  if (isColumnNull(tid, idx)) {
+    EncodeKeyNull(key);
+    return;
+  }
+
+  uchar* data = columnData(tid, idx);
+  switch ((*columns_)[idx]->type.data_type) {
+    case DataType::INT:
+    case DataType::LONG:
+      EncodeKeyInt((col_size_[idx] == 4) ? *reinterpret_cast<int32_t*>(data)
+                                         : *reinterpret_cast<int64_t*>(data),
+                   key);
+      break;
+    case DataType::DOUBLE:
+      EncodeKeyDouble(*reinterpret_cast<double*>(data), key);
+      break;
+    case DataType::CHAR: {
+      const char* str = getChar(tid, idx);
+      EncodeKeyString(str, strlen(str), key);
+      break;
+    }
+    case DataType::VARCHAR: {
+      uint32_t len;
+      const char* str = getVarchar(data, &len);
+      EncodeKeyString(str, len, key);
       break;
     }
     default:
+      EncodeKeyNull(key);
       break;
   }
 }
 
+bool TableStore::encodeKey(size_t idx, Expr* val, std::string* key) {
+  key->clear();
+  switch ((*columns_)[idx]->type.data_type) {
+    case DataType::INT:
+    case DataType::LONG:
+      if (val->type != kExprLiteralInt) return true;
+      EncodeKeyInt(val->ival, key);
+      return false;
+    case DataType::DOUBLE:
+      if (val->type != kExprLiteralFloat) return true;
+      EncodeKeyDouble(val->fval, key);
+      return false;
+    case DataType::CHAR:
+    case DataType::VARCHAR:
+      if (val->type != kExprLiteralString) return true;
+      EncodeKeyString(val->name, strlen(val->name), key);
+      return false;
+    default:
+      return true;
+  }
+}
+
+bool TableStore::isColumnMatch(TupleId tid, size_t idx, OperatorType op,
+                               const std::string& key) {
+  if (isColumnNull(tid, idx)) return false;
+
+  std::string col_key;
+  columnKey(tid, idx, &col_key);
+  int cmp = col_key.compare(key);
+  switch (op) {
+    case kOpEquals:
+      return cmp == 0;
+    case kOpNotEquals:
+      return cmp != 0;
+    case kOpLess:
+      return cmp < 0;
+    case kOpLessEq:
+      return cmp <= 0;
+    case kOpGreater:
+      return cmp > 0;
+    case kOpGreaterEq:
+      return cmp >= 0;
+    default:
+      return false;
+  }
+}
+
+// 各列的编码都不是其他值的编码的前缀，键以 key 开头时第一列的值等于常量
+bool TableStore::indexScan(TableIndex* index, OperatorType op,
+                           const std::string& key,
+                           std::vector<TupleId>* tids) {
+  bool supported = op == kOpEquals || op == kOpLess || op == kOpLessEq ||
+                   op == kOpGreater || op == kOpGreaterEq ||
+                   op == kOpNotEquals;
+  if (!supported || (index->type == kHashIndex && op != kOpEquals)) {
+    std::cout << "[LiteDB-Error]  Unsupported operator for index scan\r\n";
+    return true;
+  }
+
+  if (index->type == kHashIndex) {
+    std::vector<uint64_t> values;
+    index->hash.lookup(key, &values);
+    for (auto value : values) tids->emplace_back(UnpackTupleId(value));
+    return false;
+  }
+
+  auto has_prefix = [&key](const std::string& str) {
+    return str.compare(0, key.size(), key) == 0;
+  };
+
+  // NULL 的编码最小，小于和不等比较从第一个不为 NULL 的键开始
+  bool from_first = op == kOpLess || op == kOpLessEq || op == kOpNotEquals;
+  BPlusTree::Iterator it = from_first
+                               ? index->tree.lowerBound(std::string(1, '\1'))
+                               : index->tree.lowerBound(key);
+  for (; it.valid(); it.next()) {
+    const std::string& cur = it.key();
+    bool equal = has_prefix(cur);
+    if (op == kOpEquals && !equal) break;
+    if (op == kOpLess && cur >= key) break;
+    if (op == kOpLessEq && !equal && cur > key) break;
+    if ((op == kOpGreater || op == kOpNotEquals) && equal) continue;
+    tids->emplace_back(UnpackTupleId(it.value()));
+  }
+  return false;
+}
+
+void TableStore::updateIndexes(TupleId tid, int delta,
+                               const std::vector<size_t>* idxs) {
+  for (auto index : indexes_) {
+    if (idxs != nullptr &&
+        std::find_first_of(index->cols.begin(), index->cols.end(),
+                           idxs->begin(), idxs->end()) == index->cols.end())
+      continue;
+
+    invalidateIndexFile();
+    updateIndex(index, tid, delta);
+  }
+}
+
+void TableStore::updateIndex(TableIndex* index, TupleId tid, int delta) {
+  std::string key;
+  indexKey(tid, index, &key);
+  if (index->type == kHashIndex) {
+    if (delta > 0)
+      index->hash.insert(key, PackTupleId(tid));
+    else
+      index->hash.remove(key, PackTupleId(tid));
+  } else {
+    if (delta > 0)
+      index->tree.insert(key, PackTupleId(tid));
+    else
+      index->tree.remove(key);
+  }
+}
+
 }  // namespace litedb
\ No newline at end of file
@@ -7,109 +7,396 @@
 #include <vector>
 
 #include "sql/statements.h"
+#include "storage/btree.h"
+#include "storage/buffer_pool.h"
+#include "storage/compress.h"
+#include "storage/dictionary.h"
+#include "storage/disk.h"
+#include "storage/hash_index.h"
+#include "storage/statistics.h"
+#include "storage/string_heap.h"
+#include "storage/wal.h"
 
 using namespace hsql;
 
 namespace litedb {
 
-#define TUPLE_GROUP_SIZE 100
-#define TUPLE_HEADER_SIZE 16
+// 每个 tuple group 占用数据文件中的一页，组内的槽位数由行的大小决定
+#define TUPLE_GROUP_MAX_SLOTS 2048
+// tuple group 内位图占用的 uint64_t 个数
+#define TUPLE_GROUP_BITMAP_WORDS (TUPLE_GROUP_MAX_SLOTS / 64)
+
+#define VARCHAR_INLINE_SIZE 12
+
+// 字典编码的表中长度不小于这个值的 CHAR 列在行内只保存 4 字节的编码，更短
+// 的列编码之后不会更省空间
+#define DICT_MIN_CHAR_LENGTH 4
+
+// tuple group 已冻结，行数据按列压缩保存
+#define TUPLE_GROUP_FROZEN 0x1
+// 混合布局中行式存放的 delta tuple group
+#define TUPLE_GROUP_DELTA 0x2
+// 混合布局的表写满这么多个 delta tuple group 之后合并到 main
+#define DELTA_MERGE_GROUPS 4
 
 typedef unsigned char uchar;
 
-struct Tuple {
-  Tuple* prev;
-  Tuple* next;
-  uchar data[];
+// VARCHAR 列在行内固定占 16 字节。长度不超过 VARCHAR_INLINE_SIZE 的字符串
+// 直接存放在 data 中；更长的字符串在 data 的前 4 字节保存前缀，后 8 字节
+// 保存字符串堆中的引用。行内数据可能不对齐，需要用 memcpy 读写。
+struct VarcharSlot {
+  uint32_t len;
+  char data[VARCHAR_INLINE_SIZE];
 };
 
-class TupleList {
- public:
-  TupleList() {
-    head_ = static_cast<Tuple*>(malloc(sizeof(Tuple)));
-    tail_ = static_cast<Tuple*>(malloc(sizeof(Tuple)));
-    head_->next = tail_;
-    tail_->prev = head_;
-    head_->prev = nullptr;
-    tail_->next = nullptr;
-  }
+// 行式布局 (kRowLayout) 把一行的所有列连续存放；PAX 布局 (kPaxLayout)
+// 在每个 tuple group 内把同一列的数据连续存放，扫描少数列时更省内存带宽。
+// 混合布局 (kHybridLayout) 新建的 tuple group 是行式的 delta，写满之后由
+// MetaData::mergeDelta 转换成 PAX 布局并入 main，写入和分析扫描都比较快。
+enum TupleLayout { kRowLayout, kPaxLayout, kHybridLayout };
 
-  void addHead(Tuple* tup) {
-    Tuple* ntup = head_->next;
-    ntup->prev = tup;
-    tup->next = ntup;
-    head_->next = tup;
-    tup->prev = head_;
-  }
+// 元组在表中的位置：所在 tuple group 的下标和组内槽位
+struct TupleId {
+  uint32_t group;
+  uint32_t slot;
+};
 
-  void delTuple(Tuple* tup) {
-    Tuple* ntup = tup->next;
-    Tuple* ptup = tup->prev;
-    ptup->next = ntup;
-    ntup->prev = ptup;
-    tup->next = nullptr;
-    tup->prev = nullptr;
-  }
+inline uint64_t PackTupleId(TupleId tid) {
+  return (static_cast<uint64_t>(tid.group) << 32) | tid.slot;
+}
 
-  Tuple* popHead() {
-    if (head_->next == tail_) {
-      return nullptr;
-    }
+inline TupleId UnpackTupleId(uint64_t val) {
+  return {static_cast<uint32_t>(val >> 32), static_cast<uint32_t>(val)};
+}
 
-    Tuple* tup = head_->next;
-    delTuple(tup);
-    return tup;
-  }
+enum IndexType { kBTreeIndex, kHashIndex };
 
-  Tuple* getHead() {
-    if (head_->next == tail_) {
-      return nullptr;
-    }
-    return head_->next;
-  }
+// 表上一个索引的数据。B+ 树索引的键是索引列的值依次编码之后再加上行的
+// TupleId，相同列值的行按 TupleId 排序；哈希索引的键只有列值的编码。值
+// 都是行的 TupleId。索引只包含对扫描可见的行，和统计信息在同样的位置维护。
+struct TableIndex {
+  TableIndex() : type(kBTreeIndex) {}
 
-  Tuple* getNext(Tuple* tup) {
-    return (tup->next == tail_) ? nullptr : tup->next;
-  }
+  IndexType type;
+  // 索引列在表中的下标
+  std::vector<size_t> cols;
+  // 按 type 使用其中一个
+  BPlusTree tree;
+  HashIndex hash;
+};
 
-  bool isEmpty() { return (head_->next == tail_); }
+// tuple group 内一列的 zone map。INT/LONG 列记录 min_ival/max_ival，DOUBLE
+// 列记录 min_fval/max_fval，所有列都记录 NULL 的个数。min/max 只在写入时
+// 扩大，删除时不收缩，组内的行全部释放后才重置。
+struct ZoneMap {
+  int null_cnt;
+  int64_t min_ival;
+  int64_t max_ival;
+  double min_fval;
+  double max_fval;
+};
 
- private:
-  Tuple* head_;
-  Tuple* tail_;
+// tuple group 页的页头，之后依次是每列的 ZoneMap 和行数据。行式布局下
+// 行数据按槽位顺序存放完整的行；PAX 布局下按列存放，每列由 NULL 位图和
+// 连续的列值组成。
+// 行是定长的，used/live 位图就是页的槽位目录：used 标记已分配的槽位，live
+// 标记对扫描可见的槽位。事务中删除的行只清除 live，提交后才清除 used，
+// 保证回滚前槽位不会被复用。PAX 布局下 VACUUM FREEZE 可以冻结写满的
+// tuple group，flags 中设置 TUPLE_GROUP_FROZEN，见 TableStore::freeze。
+struct TupleGroup {
+  uint64_t lsn;
+  uint16_t slot_cnt;
+  uint16_t flags;
+  int32_t used_cnt;
+  uint64_t used[TUPLE_GROUP_BITMAP_WORDS];
+  uint64_t live[TUPLE_GROUP_BITMAP_WORDS];
+};
+
+// SHOW TABLE STATUS 显示的表的行数和空间占用，空间的单位都是字节。rows 是
+// 可见的行数，free_bytes 是已经分配的 tuple group 中空闲槽位占用的空间，
+// cached_bytes 是表的页在缓冲池中占用的内存，disk_bytes 是表的所有文件
+// 实际占用的磁盘空间
+struct TableStatus {
+  size_t rows;
+  size_t groups;
+  size_t data_bytes;
+  size_t free_bytes;
+  size_t string_bytes;
+  size_t dict_bytes;
+  size_t index_bytes;
+  size_t cached_bytes;
+  size_t disk_bytes;
 };
 
 class TableStore {
  public:
-  TableStore(std::vector<ColumnDefinition*>* columns);
+  TableStore(std::vector<ColumnDefinition*>* columns,
+             TupleLayout layout = kRowLayout, bool dict_encoding = false);
   ~TableStore();
 
+  // 打开数据文件并读入所有的 tuple group，file_id 决定数据文件的路径
+  bool open(uint32_t file_id);
+  // 把修改过的页写回数据文件
+  bool flush();
+  // 有变化时把统计信息和索引写入文件。在语句的边界调用
+  bool saveFiles();
+  // 释放 pin 住的页，页的修改写入日志
+  void releasePages();
+  // 提交前调用，持久化字典中新添加的条目
+  bool syncDictionary() { return dict_encoding_ && dictionary_.sync(); }
+
   bool insertTuple(std::vector<Expr*>* values);
-  bool deleteTuple(Tuple* tup);
-  bool updateTuple(Tuple* tup, std::vector<size_t>& idxs,
+  // 一次插入多行，任意一行失败时整批都不插入。事务中整批只记录一条 undo。
+  bool insertBatch(const std::vector<std::vector<Expr*>*>& rows);
+  bool deleteTuple(TupleId tid);
+  bool updateTuple(TupleId tid, std::vector<size_t>& idxs,
                    std::vector<Expr*>& values);
 
-  void removeTuple(Tuple* tup);
-  void recoverTuple(Tuple* tup);
-  void freeTuple(Tuple* tup);
+  // 事务 undo 使用，markDirty 失败时返回 true，这时行、索引和统计信息都
+  // 没有修改
+  bool removeTuple(TupleId tid);
+  bool recoverTuple(TupleId tid);
+  bool freeTuple(TupleId tid);
+
+  // 从 tid 开始按 tuple group 和槽位顺序查找下一个有效行，found 返回是否
+  // 找到。读页失败时返回 true
+  bool seqScan(TupleId& tid, bool* found);
+  bool isColumnEqual(TupleId tid, size_t idx, Expr* val);
+  // 字典编码的列可以先把常量换成编码，再逐行比较编码。val 不在字典中时
+  // 返回 false，这时没有行的列值等于 val
+  bool isEncoded(size_t idx) { return encoded_[idx]; }
+  bool lookupCode(size_t idx, Expr* val, uint32_t* code);
+  bool isCodeEqual(TupleId tid, size_t idx, uint32_t code) {
+    return !isColumnNull(tid, idx) &&
+           *reinterpret_cast<uint32_t*>(columnData(tid, idx)) == code;
+  }
+  // 根据 zone map 判断 tuple group 中是否可能存在第 idx 列等于 val 的行
+  bool groupMayEqual(size_t group, size_t idx, Expr* val);
+  // 按索引键的格式把常量 val 编码成第 idx 列的值。val 的类型和列不匹配时
+  // 返回 true，这时没有行的列值满足比较
+  bool encodeKey(size_t idx, Expr* val, std::string* key);
+  // 第 idx 列和 encodeKey 编码的常量比较，列值为 NULL 时不满足任何比较
+  bool isColumnMatch(TupleId tid, size_t idx, OperatorType op,
+                     const std::string& key);
+
+  // 按行式格式拷贝/恢复一行的数据，供事务 undo 使用。字符串堆中的字符串
+  // 不会被原地修改，拷贝 VARCHAR 列的引用即可；提交时由 releaseTupleData
+  // 释放 buf 中不再被引用的长字符串。
+  void copyTupleData(TupleId tid, uchar* buf);
+  bool restoreTupleData(TupleId tid, uchar* buf);
+  bool releaseTupleData(TupleId tid, uchar* buf);
+
+  // VACUUM 分两步。compact 释放已分配但不可见的槽位，再把靠后的 tuple
+  // group 中的行移动到前面的空闲槽位，修改和普通写入一样记录日志，调用时
+  // 不能有进行中的事务。shrink 截掉文件末尾空的页，调用前修改要已经写回
+  // 数据文件并截断了日志，否则恢复时日志会重新写出被截掉的页。moved 和
+  // freed 累加移动的行数和释放的页数
+  bool compact(size_t* moved);
+  bool shrink(size_t* freed);
+  // 压缩 PAX 布局中写满的 tuple group 的 INT/LONG 列和字典编码的列，frozen
+  // 累加冻结的 tuple group 数。冻结的页末尾空出的磁盘块写回时打洞释放；
+  // 页被修改时先解压。行式存放的 tuple group 不做处理
+  bool freeze(size_t* frozen);
+  // 混合布局中写满的 delta tuple group 是否已经足够多，需要合并
+  bool needMerge() { return full_deltas_.size() >= DELTA_MERGE_GROUPS; }
+  // 把写满的 delta tuple group 原地转换成 PAX 布局，行的位置不变。all 为
+  // false 时只合并 needMerge 记录的 tuple group，否则检查所有的 tuple
+  // group。merged 累加合并的 tuple group 数
+  bool merge(bool all, size_t* merged);
+
+  // 第一次调用时读所有 tuple group 的页头统计行数，之后随插入和删除维护
+  bool status(TableStatus* status);
+
+  // 扫描所有可见的行构建 index，之后随行的修改维护。index 的内存由调用者
+  // 管理，释放前要先 removeIndex
+  bool addIndex(TableIndex* index);
+  void removeIndex(TableIndex* index);
+  // 打开表时加入所有的索引。开启 g_persist_indexes 时先从检查点写入的索引
+  // 文件加载，文件中没有的索引再扫描构建
+  bool openIndexes(const std::vector<TableIndex*>& indexes);
+  // 在 index 中查找第一列和 encodeKey 编码的常量满足比较 op 的行，按索引
+  // 的顺序追加到 tids。哈希索引只支持单列索引的等值查找，不支持的比较
+  // 返回 true
+  bool indexScan(TableIndex* index, OperatorType op, const std::string& key,
+                 std::vector<TupleId>* tids);
 
-  Tuple* seqScan(Tuple* tup);
-  void parseTuple(Tuple* tup, std::vector<Expr*>& values);
+  // 扫描所有可见的行重新统计，并写入统计信息文件
+  bool analyze();
+  TableStats* stats() { return &stats_; }
 
   int tupleSize() { return tuple_size_; }
+  TupleLayout layout() { return layout_; }
+  bool dictEncoding() { return dict_encoding_; }
 
  private:
+  friend class TupleView;
+
+  // 返回 tuple group 所在的页。TableStore 一直 pin 住最近访问的一页，返回的
+  // 地址在访问其他 tuple group 之前有效。读页失败时返回一个空的页，修改数据
+  // 前要先通过 markDirty 检查页是否可用。开启 g_use_mmap 时，缓冲池中没有
+  // 的页返回只读的文件映射，write 为 true 时总是返回缓冲池中的页。
+  uchar* page(size_t group, bool sequential = false, bool write = false);
+  void unpinPage();
+  TupleGroup* tupleGroup(size_t group) {
+    return reinterpret_cast<TupleGroup*>(page(group));
+  }
+  ZoneMap* zoneMaps(size_t group) {
+    return reinterpret_cast<ZoneMap*>(page(group) + sizeof(TupleGroup));
+  }
+  uchar* groupData(size_t group) { return page(group) + data_offset_; }
+  // 修改 tuple group 之前调用，冻结的 tuple group 会被解压
+  bool markDirty(size_t group);
+  bool isFrozen(size_t group) {
+    return layout_ != kRowLayout &&
+           (tupleGroup(group)->flags & TUPLE_GROUP_FROZEN);
+  }
+  // tuple group 是否按行存放
+  bool isRowGroup(size_t group) {
+    return layout_ == kRowLayout ||
+           (layout_ == kHybridLayout &&
+            (tupleGroup(group)->flags & TUPLE_GROUP_DELTA));
+  }
+  EncodedColumn* encodedColumns(size_t group) {
+    return reinterpret_cast<EncodedColumn*>(groupData(group));
+  }
+  bool isCompressible(size_t idx);
+  void collectValues(size_t group, size_t idx, int64_t* values);
+  bool freezeGroup(size_t group, bool* done);
+  void thawGroup(size_t group);
+  bool mergeGroup(size_t group);
+  // 行对扫描可见 (delta 为 1) 或不可见 (delta 为 -1) 时更新统计信息
+  void updateStats(TupleId tid, int delta);
+  void updateColumnStats(TupleId tid, size_t idx, int delta);
+  // 统计信息使用的列值的哈希，数值列的值通过 val 返回
+  uint64_t columnHash(TupleId tid, size_t idx, double* val, bool* numeric);
+  // 行对扫描可见或不可见时更新索引。idxs 不为 nullptr 时只更新包含其中
+  // 某一列的索引
+  void updateIndexes(TupleId tid, int delta,
+                     const std::vector<size_t>* idxs = nullptr);
+  void updateIndex(TableIndex* index, TupleId tid, int delta);
+  // 索引文件 <表 id>.idx 保存所有索引的项。文件只在和数据一致时存在：
+  // 索引被修改、加入或移除时删除文件，检查点之后的第一次提交或者显式的
+  // 检查点中没有未提交的修改时重新写入。恢复时重放了写入文件之后的日志的
+  // 表不使用文件
+  void loadIndexes(const std::vector<TableIndex*>& indexes,
+                   std::vector<bool>* loaded);
+  bool saveIndexes();
+  void invalidateIndexFile();
+  void indexKey(TupleId tid, TableIndex* index, std::string* key);
+  // 把第 idx 列的值编码后追加到 key
+  void columnKey(TupleId tid, size_t idx, std::string* key);
+
   bool newTupleGroup();
-  void setColValue(Tuple* tup, int idx, Expr* expr);
+  void resetZoneMaps(size_t group);
+  void widenZoneMap(TupleId tid, size_t idx);
+  bool allocTuple(TupleId* tid);
+  bool reserveTuples(size_t cnt);
+  bool fillTuple(TupleId tid, std::vector<Expr*>* values);
+  // 按 copyTupleData 的格式写入一行，不释放槽位中原有的字符串
+  void writeTupleData(TupleId tid, uchar* buf);
+  bool moveTuple(TupleId from, TupleId to, uchar* buf);
+  bool setColValue(TupleId tid, int idx, Expr* expr);
+  const char* getChar(TupleId tid, size_t idx);
+  const char* getVarchar(uchar* ptr, uint32_t* len);
+  void releaseVarchar(uchar* ptr);
+  bool isColumnNull(TupleId tid, size_t idx);
+  // 空闲槽位的 NULL 标记都为 false，标记变化时同步更新 zone map 的 null_cnt
+  bool isVarchar(size_t idx) {
+    return (*columns_)[idx]->type.data_type == DataType::VARCHAR;
+  }
+  void setColumnNull(TupleId tid, size_t idx, bool is_null);
+  uint64_t* nullMap(size_t group, size_t idx);
+  // 冻结的 tuple group 中压缩的列返回解码到 decoded_ 中的值，在下次读取
+  // 同一列之前有效
+  uchar* columnData(TupleId tid, size_t idx);
 
   int col_num_;
   int tuple_size_;
+  int group_slots_;
+  // 页内行数据的起始偏移和 PAX 布局下每列 NULL 位图占用的 uint64_t 个数
+  int data_offset_;
+  int bitmap_words_;
+  TupleLayout layout_;
+  bool dict_encoding_;
+  // 每列是否字典编码
+  std::vector<bool> encoded_;
 
   std::vector<ColumnDefinition*>* columns_;
+  // 行式存放时列在行内的偏移
+  std::vector<int> row_offset_;
+  // PAX 布局下列在页内行数据中的偏移，行式布局的表为空
   std::vector<int> col_offset_;
-  std::vector<Tuple*> tuple_groups_;
-  TupleList free_list_;
-  TupleList data_list_;
+  std::vector<int> col_size_;
+  std::vector<int64_t> decoded_;
+  // 第 i 个 tuple group 是数据文件的第 i 页
+  size_t group_cnt_;
+  Frame* frame_;
+  size_t frame_group_;
+  // 最近一次从文件映射中读取的页
+  uchar* mapped_page_;
+  size_t mapped_group_;
+  PageLog page_log_;
+  // 上次写回之后修改过的 tuple group
+  std::vector<bool> dirty_;
+  std::vector<uint32_t> dirty_groups_;
+  // 下标小于 free_group_ 的 tuple group 都没有空闲槽位
+  size_t free_group_;
+  // 写满之后还没有合并的 delta tuple group，重新打开表时不会恢复
+  std::vector<uint32_t> full_deltas_;
+  DiskFile file_;
+  StringHeap string_heap_;
+  Dictionary dictionary_;
+  TableStats stats_;
+  std::string stats_path_;
+  std::vector<TableIndex*> indexes_;
+  uint32_t file_id_;
+  std::string index_path_;
+  // 索引文件存在并且和当前的索引一致
+  bool index_file_valid_;
+};
+
+// 指向存储中一行数据的轻量视图，按列类型直接读取存储中的值，不拷贝数据。
+// 视图在对应的行被释放之前有效。
+class TupleView {
+ public:
+  TupleView(TableStore* table_store, TupleId tid)
+      : table_store_(table_store), tid_(tid) {}
+
+  TupleId tid() const { return tid_; }
+  void reset(TupleId tid) { tid_ = tid; }
+
+  bool isNull(size_t idx) const {
+    return table_store_->isColumnNull(tid_, idx);
+  }
+  int32_t getInt(size_t idx) const {
+    return *reinterpret_cast<int32_t*>(table_store_->columnData(tid_, idx));
+  }
+  int64_t getLong(size_t idx) const {
+    return *reinterpret_cast<int64_t*>(table_store_->columnData(tid_, idx));
+  }
+  double getDouble(size_t idx) const {
+    return *reinterpret_cast<double*>(table_store_->columnData(tid_, idx));
+  }
+  // CHAR 列以 '\0' 结尾
+  const char* getChar(size_t idx) const {
+    return table_store_->getChar(tid_, idx);
+  }
+  // VARCHAR 列不以 '\0' 结尾，长度通过 len 返回
+  const char* getVarchar(size_t idx, uint32_t* len) const {
+    return table_store_->getVarchar(table_store_->columnData(tid_, idx), len);
+  }
+
+ private:
+  TableStore* table_store_;
+  TupleId tid_;
 };
 
+extern TupleLayout g_default_layout;
+// 新建的表使用字典编码 (--dict)
+extern bool g_dict_encoding;
+// 检查点之后把索引写入文件，重新打开表时不用扫描构建 (--persist-indexes)
+extern bool g_persist_indexes;
+// 批量构建 B+ 树索引时节点填充的百分比 (--index-fill)
+extern int g_index_fill_factor;
+
 }  // namespace litedb
\ No newline at end of file
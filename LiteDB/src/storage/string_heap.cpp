@@ -0,0 +1,237 @@
+#include "string_heap.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace litedb {
+
+StringHeap::~StringHeap() {
+  page_log_.reset();
+  if (frame_ != nullptr) g_buffer_pool.unpinPage(frame_);
+  g_buffer_pool.dropFile(&file_);
+}
+
+bool StringHeap::open(uint32_t file_id) {
+  if (file_.open(DataFilePath(file_id, ".str"))) return true;
+  if (g_use_mmap) file_.enableMap();
+  page_log_.setFile(file_id, kStringFile);
+
+  // 不读任何页，空闲页在第一次复用时由 scanFreePages 找出。最后一页是空洞
+  // 页时 addString 会换到新页
+  opened_pages_ = file_.pageCount();
+  pages_.resize(opened_pages_, {false, false});
+  cur_page_ = static_cast<int>(opened_pages_) - 1;
+  return false;
+}
+
+bool StringHeap::flush() {
+  unpinPage();
+
+  bool dirty = false;
+  for (uint32_t i = 0; i < pages_.size(); i++) {
+    if (!pages_[i].dirty) continue;
+
+    if (pages_[i].free) {
+      g_buffer_pool.discardPage(&file_, i);
+      if (file_.punchPage(i)) return true;
+    } else {
+      if (g_buffer_pool.flushPage(&file_, i)) return true;
+    }
+    pages_[i].dirty = false;
+    dirty = true;
+  }
+
+  return dirty ? file_.sync() : false;
+}
+
+bool StringHeap::addString(const char* str, uint32_t len, uint64_t* ref) {
+  if (len > STRING_PAGE_CAPACITY) {
+    // 放不进一页的字符串从文件末尾开始占用连续的多页
+    int first = -1;
+    for (uint32_t done = 0; done < len; done += STRING_PAGE_CAPACITY) {
+      int page_no = newPage(false);
+      if (page_no < 0) return true;
+      if (first < 0) first = page_no;
+
+      uint32_t part = len - done;
+      if (part > STRING_PAGE_CAPACITY) part = STRING_PAGE_CAPACITY;
+      char* data = frame_->data;
+      StringPageHeader* hdr = reinterpret_cast<StringPageHeader*>(data);
+      memcpy(data + hdr->used, str + done, part);
+      hdr->used += part;
+      hdr->live_bytes += part;
+    }
+    *ref = (static_cast<uint64_t>(first) << 32) | sizeof(StringPageHeader);
+    return false;
+  }
+
+  if (cur_page_ < 0 || header(cur_page_) == nullptr ||
+      header(cur_page_)->used < sizeof(StringPageHeader) ||
+      header(cur_page_)->used + len > PAGE_SIZE) {
+    int page_no = newPage(true);
+    if (page_no < 0) return true;
+    cur_page_ = page_no;
+  }
+
+  char* data = writePage(cur_page_);
+  if (data == nullptr) return true;
+  StringPageHeader* hdr = reinterpret_cast<StringPageHeader*>(data);
+  memcpy(data + hdr->used, str, len);
+  *ref = (static_cast<uint64_t>(cur_page_) << 32) | hdr->used;
+  hdr->used += len;
+  hdr->live_bytes += len;
+  return false;
+}
+
+const char* StringHeap::getString(uint64_t ref, uint32_t len) {
+  uint32_t page_no = ref >> 32;
+  uint32_t offset = static_cast<uint32_t>(ref);
+  if (offset + len <= PAGE_SIZE) {
+    char* data = page(page_no);
+    if (data != nullptr) return data + offset;
+    concat_buf_.assign(len, '\0');
+    return concat_buf_.data();
+  }
+
+  concat_buf_.clear();
+  for (uint32_t done = 0; done < len; page_no++) {
+    StringPageHeader* hdr = header(page_no);
+    if (hdr == nullptr) {
+      concat_buf_.assign(len, '\0');
+      break;
+    }
+    uint32_t part = hdr->used - sizeof(StringPageHeader);
+    concat_buf_.append(page(page_no) + sizeof(StringPageHeader), part);
+    done += part;
+  }
+
+  return concat_buf_.data();
+}
+
+void StringHeap::releaseString(uint64_t ref, uint32_t len) {
+  uint32_t page_no = ref >> 32;
+  uint32_t offset = static_cast<uint32_t>(ref);
+
+  while (len > 0) {
+    uint32_t part = len;
+    if (offset + part > PAGE_SIZE) part = PAGE_SIZE - offset;
+    len -= part;
+    offset = sizeof(StringPageHeader);
+
+    char* data = writePage(page_no);
+    if (data == nullptr) return;
+    StringPageHeader* hdr = reinterpret_cast<StringPageHeader*>(data);
+    hdr->live_bytes -= part;
+    if (hdr->live_bytes == 0) {
+      if (static_cast<int>(page_no) == cur_page_) {
+        hdr->used = sizeof(StringPageHeader);
+      } else {
+        // 页留在缓冲池中照常写回，flush 时才丢弃并打洞
+        unpinPage();
+        pages_[page_no].free = true;
+        free_pages_.emplace_back(page_no);
+      }
+    }
+    page_no++;
+  }
+}
+
+bool StringHeap::shrink(size_t* freed) {
+  if (!free_scanned_) scanFreePages();
+  unpinPage();
+
+  uint32_t cnt = pages_.size();
+  while (cnt > 0 && pages_[cnt - 1].free && !pages_[cnt - 1].dirty) cnt--;
+  if (cnt == pages_.size()) return false;
+
+  for (uint32_t i = cnt; i < pages_.size(); i++)
+    g_buffer_pool.discardPage(&file_, i);
+  if (file_.truncate(cnt)) return true;
+
+  free_pages_.erase(std::remove_if(free_pages_.begin(), free_pages_.end(),
+                                   [cnt](uint32_t i) { return i >= cnt; }),
+                    free_pages_.end());
+  *freed += pages_.size() - cnt;
+  pages_.resize(cnt);
+  if (opened_pages_ > cnt) opened_pages_ = cnt;
+  return false;
+}
+
+void StringHeap::unpinPage() {
+  mapped_page_ = nullptr;
+  if (frame_ == nullptr) return;
+  page_log_.end();
+  g_buffer_pool.unpinPage(frame_);
+  frame_ = nullptr;
+}
+
+// reuse 为 true 时优先复用已经释放的页，否则在文件末尾追加新页
+int StringHeap::newPage(bool reuse) {
+  if (reuse && !free_scanned_) scanFreePages();
+
+  uint32_t page_no;
+  if (reuse && !free_pages_.empty()) {
+    page_no = free_pages_.back();
+  } else {
+    page_no = pages_.size();
+  }
+
+  unpinPage();
+  frame_ = g_buffer_pool.newPage(&file_, page_no);
+  if (frame_ == nullptr) return -1;
+  if (page_log_.begin(frame_, true)) return -1;
+
+  if (page_no == pages_.size())
+    pages_.push_back({true, false});
+  else
+    free_pages_.pop_back();
+  pages_[page_no] = {true, false};
+  reinterpret_cast<StringPageHeader*>(frame_->data)->used =
+      sizeof(StringPageHeader);
+  return page_no;
+}
+
+// 找出打开时文件中字符串全部释放的页 (包括空洞页)，之后追加的页和本次
+// 运行中释放的页已经在 free_pages_ 中
+void StringHeap::scanFreePages() {
+  free_scanned_ = true;
+  for (uint32_t i = 0; i < opened_pages_; i++) {
+    if (pages_[i].free || static_cast<int>(i) == cur_page_) continue;
+    StringPageHeader* hdr = header(i);
+    if (hdr != nullptr && hdr->live_bytes == 0) {
+      pages_[i].free = true;
+      free_pages_.emplace_back(i);
+    }
+  }
+}
+
+char* StringHeap::page(uint32_t page_no, bool write) {
+  if (frame_ != nullptr && frame_->page_no == page_no) return frame_->data;
+  if (!write && mapped_page_ != nullptr && mapped_no_ == page_no)
+    return mapped_page_;
+
+  unpinPage();
+  if (g_use_mmap && !write && !g_buffer_pool.contains(&file_, page_no)) {
+    const char* data = file_.mappedPage(page_no);
+    if (data != nullptr) {
+      mapped_page_ = const_cast<char*>(data);
+      mapped_no_ = page_no;
+      return mapped_page_;
+    }
+  }
+
+  frame_ = g_buffer_pool.fetchPage(&file_, page_no);
+  return (frame_ == nullptr) ? nullptr : frame_->data;
+}
+
+char* StringHeap::writePage(uint32_t page_no) {
+  char* data = page(page_no, true);
+  if (data == nullptr || page_log_.begin(frame_)) return nullptr;
+
+  g_buffer_pool.markDirty(frame_);
+  pages_[page_no].dirty = true;
+  return data;
+}
+
+}  // namespace litedb
\ No newline at end of file
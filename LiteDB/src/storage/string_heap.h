@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "storage/buffer_pool.h"
+#include "storage/disk.h"
+#include "storage/wal.h"
+
+namespace litedb {
+
+// 字符串堆页的页头。used 是页内已经写入的字节数 (包括页头)，live_bytes
+// 是其中还被引用的字符串字节数。
+struct StringPageHeader {
+  uint64_t lsn;
+  uint32_t used;
+  uint32_t live_bytes;
+};
+
+#define STRING_PAGE_CAPACITY (PAGE_SIZE - sizeof(StringPageHeader))
+
+// 表内的长字符串堆，保存在单独的数据文件中，页通过缓冲池访问。字符串按
+// 追加方式写入页，写入后不再修改，通过 (页号 << 32 | 页内偏移) 的引用访问。
+// 放不进一页的字符串占用连续的多页。页内的字符串全部释放后整页归还给系统，
+// 之后可以复用。
+class StringHeap {
+ public:
+  StringHeap()
+      : free_scanned_(false),
+        opened_pages_(0),
+        cur_page_(-1),
+        frame_(nullptr),
+        mapped_page_(nullptr),
+        mapped_no_(0) {}
+  ~StringHeap();
+
+  // 打开编号为 file_id 的表的字符串堆文件
+  bool open(uint32_t file_id);
+  // 把修改过的页写回文件
+  bool flush();
+
+  bool addString(const char* str, uint32_t len, uint64_t* ref);
+  // 跨页的字符串会拼接到内部缓冲区，返回的指针在下一次调用前有效
+  const char* getString(uint64_t ref, uint32_t len);
+  void releaseString(uint64_t ref, uint32_t len);
+  // 截掉文件末尾的空闲页，调用前修改要已经写回文件并截断了日志。freed
+  // 累加释放的页数
+  bool shrink(size_t* freed);
+  // 释放 pin 住的页，页的修改写入日志
+  void unpinPage();
+
+  DiskFile* file() { return &file_; }
+  uint32_t pageCount() { return pages_.size(); }
+
+ private:
+  struct PageState {
+    bool dirty;
+    bool free;
+  };
+
+  int newPage(bool reuse);
+  void scanFreePages();
+  // 返回页的地址。字符串堆一直 pin 住最近访问的一页，返回的地址在访问其他
+  // 页之前有效。读页失败时返回 nullptr。开启 g_use_mmap 时，缓冲池中没有
+  // 的页返回只读的文件映射，write 为 true 时总是返回缓冲池中的页。
+  char* page(uint32_t page_no, bool write = false);
+  // 修改页之前调用，返回 pin 住的页，失败时返回 nullptr
+  char* writePage(uint32_t page_no);
+  StringPageHeader* header(uint32_t page_no) {
+    return reinterpret_cast<StringPageHeader*>(page(page_no));
+  }
+
+  DiskFile file_;
+  std::vector<PageState> pages_;
+  // 已经归还给系统、可以复用的页
+  std::vector<uint32_t> free_pages_;
+  // 打开时不读页，第一次需要复用页时才扫描文件中已有的空闲页
+  bool free_scanned_;
+  uint32_t opened_pages_;
+  int cur_page_;
+  Frame* frame_;
+  char* mapped_page_;
+  uint32_t mapped_no_;
+  PageLog page_log_;
+  std::string concat_buf_;
+};
+
+}  // namespace litedb
\ No newline at end of file
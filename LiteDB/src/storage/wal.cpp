@@ -0,0 +1,573 @@
+#include "wal.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <unordered_set>
+
+#include "storage/metadata.h"
+
+namespace litedb {
+
+int g_commit_delay = 0;
+Wal g_wal;
+
+// 日志文件头，之后是连续的日志记录
+struct WalHeader {
+  char magic[8];
+  uint64_t start_lsn;
+};
+
+#define WAL_MAGIC "LiteWAL"
+
+// 只比较 8 字节对齐的整字，间隔不超过 WAL_RANGE_GAP 的修改合并成一个区间
+#define WAL_RANGE_GAP 32
+
+static std::string WalPath() { return g_data_dir + "/wal"; }
+
+// FNV-1a，用来识别没有写完整的日志记录
+static uint32_t LogChecksum(const char* data, size_t len) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= static_cast<uint8_t>(data[i]);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+Wal::~Wal() {
+  if (writer_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    flush_cv_.notify_one();
+    writer_.join();
+  }
+  if (fd_ >= 0) close(fd_);
+}
+
+bool Wal::open() {
+  fd_ = ::open(WalPath().c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd_ < 0) {
+    std::cout << "[LiteDB-Error]  Failed to open " << WalPath() << ": "
+              << strerror(errno) << "\r\n";
+    return true;
+  }
+
+  WalHeader hdr;
+  ssize_t ret = pread(fd_, &hdr, sizeof(hdr), 0);
+  if (ret == 0) {
+    // 新建的日志
+    if (writeHeader(fd_, start_lsn_)) return true;
+  } else if (ret != sizeof(hdr) || strcmp(hdr.magic, WAL_MAGIC) != 0) {
+    std::cout << "[LiteDB-Error]  Invalid log " << WalPath() << "\r\n";
+    return true;
+  } else {
+    start_lsn_ = hdr.start_lsn;
+  }
+  durable_lsn_ = next_lsn_ = start_lsn_;
+
+  if (recover()) return true;
+  writer_ = std::thread(&Wal::writerLoop, this);
+  return false;
+}
+
+bool Wal::writeHeader(int fd, uint64_t start_lsn) {
+  WalHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  strcpy(hdr.magic, WAL_MAGIC);
+  hdr.start_lsn = start_lsn;
+  if (pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || fdatasync(fd) < 0) {
+    std::cout << "[LiteDB-Error]  Failed to write log header: "
+              << strerror(errno) << "\r\n";
+    return true;
+  }
+
+  return false;
+}
+
+uint64_t Wal::append(LogRecordHeader* hdr, const std::string& body) {
+  if (recovering_) return 0;
+
+  hdr->size = sizeof(LogRecordHeader) + body.size();
+  hdr->trx_id = trx_id_;
+  std::string record(reinterpret_cast<char*>(hdr), sizeof(LogRecordHeader));
+  record += body;
+  hdr->checksum = LogChecksum(record.data() + 8, record.size() - 8);
+  memcpy(&record[4], &hdr->checksum, sizeof(hdr->checksum));
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (fd_ < 0) return 0;
+  uint64_t lsn = next_lsn_;
+  buf_ += record;
+  next_lsn_ += record.size();
+  if (hdr->type == kLogCommit) {
+    trx_first_lsn_ = 0;
+  } else {
+    if (trx_first_lsn_ == 0) trx_first_lsn_ = lsn;
+    trx_logged_ = true;
+  }
+  return lsn;
+}
+
+uint64_t Wal::logPage(uint32_t table_id, PageFileType file_type,
+                      uint32_t page_no, const std::vector<LogRange>& ranges,
+                      const char* before, const char* after,
+                      bool image) {
+  std::string body;
+  if (image) body.append(before, PAGE_SIZE);
+  for (auto& range : ranges) {
+    body.append(reinterpret_cast<const char*>(&range), sizeof(range));
+    body.append(before + range.offset, range.len);
+    body.append(after + range.offset, range.len);
+  }
+
+  LogRecordHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.type = image ? kLogPageImage : kLogPage;
+  hdr.file_type = file_type;
+  hdr.range_cnt = ranges.size();
+  hdr.table_id = table_id;
+  hdr.page_no = page_no;
+  return append(&hdr, body);
+}
+
+uint64_t Wal::logInitPage(uint32_t table_id, PageFileType file_type,
+                          uint32_t page_no) {
+  LogRecordHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.type = kLogInitPage;
+  hdr.file_type = file_type;
+  hdr.table_id = table_id;
+  hdr.page_no = page_no;
+  return append(&hdr, "");
+}
+
+// catalog 在 DDL 时直接修改，修改前日志必须先持久化，恢复时才能撤销
+bool Wal::logCreateTable(Table* table) {
+  LogRecordHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.type = kLogCreateTable;
+  hdr.table_id = table->id();
+  append(&hdr, table->definition());
+  return flush();
+}
+
+bool Wal::logDropTable(Table* table) {
+  LogRecordHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.type = kLogDropTable;
+  hdr.table_id = table->id();
+  append(&hdr, table->definition());
+  return flush();
+}
+
+bool Wal::commit() {
+  if (!trx_logged_) return false;
+
+  LogRecordHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.type = kLogCommit;
+  append(&hdr, "");
+  trx_logged_ = false;
+  trx_id_++;
+  return waitDurable(nextLsn(), true);
+}
+
+// 日志按记录整条写入，持久化的位置大于页的 LSN 时整条记录都已经持久化
+bool Wal::flushTo(uint64_t lsn) { return waitDurable(lsn + 1, false); }
+
+bool Wal::flush() { return waitDurable(nextLsn(), false); }
+
+bool Wal::waitDurable(uint64_t lsn, bool commit) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (fd_ < 0 || lsn <= durable_lsn_) return false;
+
+  if (lsn > flush_lsn_) flush_lsn_ = lsn;
+  if (commit) group_commit_ = true;
+  flush_cv_.notify_one();
+  durable_cv_.wait(lock, [&] { return failed_ || durable_lsn_ >= lsn; });
+  return durable_lsn_ < lsn;
+}
+
+void Wal::writerLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    flush_cv_.wait(lock, [this] {
+      return stop_ || (!failed_ && flush_lsn_ > durable_lsn_);
+    });
+    if (failed_ || flush_lsn_ <= durable_lsn_) return;
+
+    if (group_commit_ && g_commit_delay > 0) {
+      // 等待更多的提交记录，一次 fsync 持久化
+      lock.unlock();
+      std::this_thread::sleep_for(std::chrono::microseconds(g_commit_delay));
+      lock.lock();
+    }
+    group_commit_ = false;
+
+    std::string data;
+    data.swap(buf_);
+    writing_ = true;
+    uint64_t end_lsn = durable_lsn_ + data.size();
+    off_t off = sizeof(WalHeader) + file_size_;
+    int fd = fd_;
+    lock.unlock();
+
+    bool err = pwrite(fd, data.data(), data.size(), off) !=
+                   static_cast<ssize_t>(data.size()) ||
+               fdatasync(fd) < 0;
+    if (err)
+      std::cout << "[LiteDB-Error]  Failed to write log: " << strerror(errno)
+                << "\r\n";
+
+    lock.lock();
+    writing_ = false;
+    if (err) {
+      failed_ = true;
+    } else {
+      file_size_ += data.size();
+      durable_lsn_ = end_lsn;
+    }
+    durable_cv_.notify_all();
+  }
+}
+
+uint64_t Wal::nextLsn() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return next_lsn_;
+}
+
+uint64_t Wal::recoveredLsn(uint32_t table_id) {
+  auto iter = recovered_lsns_.find(table_id);
+  return (iter != recovered_lsns_.end()) ? iter->second : 0;
+}
+
+uint64_t Wal::activeTrxLsn() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return trx_first_lsn_ != 0 ? trx_first_lsn_ : next_lsn_;
+}
+
+uint64_t Wal::size() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return next_lsn_ - start_lsn_;
+}
+
+// 保留的日志和新的日志头先写入临时文件再 rename，任何时候崩溃日志都是
+// 完整的。复制期间持有 mutex_，新的日志追加到 buf_ 中等待写入新文件。
+bool Wal::truncate(uint64_t lsn) {
+  if (flush()) return true;
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  durable_cv_.wait(lock, [this] { return !writing_; });
+  if (lsn > durable_lsn_) lsn = durable_lsn_;
+  if (fd_ < 0 || lsn <= start_lsn_) return false;
+
+  std::string tail(durable_lsn_ - lsn, '\0');
+  off_t off = sizeof(WalHeader) + (lsn - start_lsn_);
+  if (!tail.empty() &&
+      pread(fd_, &tail[0], tail.size(), off) !=
+          static_cast<ssize_t>(tail.size())) {
+    std::cout << "[LiteDB-Error]  Failed to read log " << WalPath() << "\r\n";
+    return true;
+  }
+
+  std::string tmp_path = WalPath() + ".tmp";
+  int fd = ::open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::cout << "[LiteDB-Error]  Failed to open " << tmp_path << ": "
+              << strerror(errno) << "\r\n";
+    return true;
+  }
+
+  if (pwrite(fd, tail.data(), tail.size(), sizeof(WalHeader)) !=
+          static_cast<ssize_t>(tail.size()) ||
+      writeHeader(fd, lsn)) {
+    std::cout << "[LiteDB-Error]  Failed to write " << tmp_path << "\r\n";
+    close(fd);
+    return true;
+  }
+  if (rename(tmp_path.c_str(), WalPath().c_str()) < 0) {
+    std::cout << "[LiteDB-Error]  Failed to rename " << tmp_path << ": "
+              << strerror(errno) << "\r\n";
+    close(fd);
+    return true;
+  }
+
+  // rename 要落盘，否则崩溃之后目录项可能仍然指向旧的日志，之后提交到新
+  // 文件中的事务都会丢失。rename 已经生效，同步失败时也切换到新文件
+  int dir = ::open(g_data_dir.c_str(), O_RDONLY);
+  bool err = dir < 0 || fsync(dir) != 0;
+  if (err)
+    std::cout << "[LiteDB-Error]  Failed to sync " << g_data_dir << ": "
+              << strerror(errno) << "\r\n";
+  if (dir >= 0) close(dir);
+
+  close(fd_);
+  fd_ = fd;
+  start_lsn_ = lsn;
+  file_size_ = tail.size();
+  return err;
+}
+
+// 恢复时直接读写数据文件，修改过的页缓存在内存中，恢复结束后统一写回
+class RecoveryPages {
+ public:
+  ~RecoveryPages() {
+    for (auto iter : files_) delete iter.second;
+  }
+
+  char* get(uint32_t table_id, uint8_t file_type, uint32_t page_no) {
+    uint64_t file_key = (static_cast<uint64_t>(table_id) << 1) | file_type;
+    auto key = std::make_pair(file_key, page_no);
+    auto iter = pages_.find(key);
+    if (iter != pages_.end()) return &iter->second[0];
+
+    DiskFile* file = getFile(file_key);
+    if (file == nullptr) return nullptr;
+
+    // 没有写回过的页在文件之外，内容全为 0
+    std::string& data = pages_[key];
+    data.assign(PAGE_SIZE, '\0');
+    if (page_no < file->pageCount() && file->readPage(page_no, &data[0]))
+      return nullptr;
+    return &data[0];
+  }
+
+  bool writeAll() {
+    for (auto& iter : pages_) {
+      DiskFile* file = files_[iter.first.first];
+      if (file->writePage(iter.first.second, iter.second.data())) return true;
+    }
+    for (auto iter : files_)
+      if (iter.second->sync()) return true;
+
+    return false;
+  }
+
+ private:
+  DiskFile* getFile(uint64_t file_key) {
+    auto iter = files_.find(file_key);
+    if (iter != files_.end()) return iter->second;
+
+    DiskFile* file = new DiskFile();
+    const char* suffix = (file_key & 1) == kStringFile ? ".str" : ".tbl";
+    if (file->open(DataFilePath(file_key >> 1, suffix))) {
+      delete file;
+      return nullptr;
+    }
+    files_[file_key] = file;
+    return file;
+  }
+
+  std::map<uint64_t, DiskFile*> files_;
+  std::map<std::pair<uint64_t, uint32_t>, std::string> pages_;
+};
+
+// 按表的定义新建表，同名的表已经存在时不做任何事
+static void RecoverCreateTable(const char* def, size_t len) {
+  std::istringstream in(std::string(def, len));
+  std::string word;
+  in >> word;
+  Table* table = Table::parse(in);
+  if (table == nullptr) return;
+
+  if (g_meta_data.getTable(table->schema(), table->name()) != nullptr ||
+      g_meta_data.insertTable(table))
+    delete table;
+}
+
+// 只删除编号相同的表，避免误删之后重新创建的同名表
+static void RecoverDropTable(uint32_t table_id, const char* def, size_t len) {
+  std::istringstream in(std::string(def, len));
+  std::string word;
+  in >> word;
+  Table* table = Table::parse(in);
+  if (table == nullptr) return;
+
+  Table* cur = g_meta_data.getTable(table->schema(), table->name());
+  if (cur != nullptr && cur->id() == table_id)
+    g_meta_data.dropTable(table->schema(), table->name());
+  delete table;
+}
+
+bool Wal::recover() {
+  struct stat st;
+  if (fstat(fd_, &st) < 0) return true;
+
+  std::string log(st.st_size - sizeof(WalHeader), '\0');
+  if (!log.empty() && pread(fd_, &log[0], log.size(), sizeof(WalHeader)) !=
+                          static_cast<ssize_t>(log.size())) {
+    std::cout << "[LiteDB-Error]  Failed to read log " << WalPath() << "\r\n";
+    return true;
+  }
+
+  // 找到所有完整的记录，最后一条不完整的记录之后的内容都丢弃
+  std::vector<size_t> records;
+  std::unordered_set<uint64_t> committed;
+  size_t pos = 0;
+  while (pos + sizeof(LogRecordHeader) <= log.size()) {
+    LogRecordHeader hdr;
+    memcpy(&hdr, &log[pos], sizeof(hdr));
+    if (hdr.size < sizeof(hdr) || pos + hdr.size > log.size() ||
+        LogChecksum(&log[pos + 8], hdr.size - 8) != hdr.checksum)
+      break;
+
+    if (hdr.type == kLogCommit) committed.emplace(hdr.trx_id);
+    records.emplace_back(pos);
+    pos += hdr.size;
+  }
+  if (records.empty()) {
+    // 丢弃没有写完的记录
+    if (!log.empty() && (ftruncate(fd_, sizeof(WalHeader)) < 0 ||
+                         fdatasync(fd_) < 0)) {
+      std::cout << "[LiteDB-Error]  Failed to truncate log " << WalPath()
+                << ": " << strerror(errno) << "\r\n";
+      return true;
+    }
+    return false;
+  }
+
+  std::cout << "[LiteDB-Info]  Recovering from " << records.size()
+            << " log records\r\n";
+  recovering_ = true;
+  RecoveryPages pages;
+
+  // redo: 重做所有 LSN 大于页 LSN 的修改，包括没有提交的事务。整页的记录
+  // 不看页 LSN，数据文件中的页可能只写了一部分，页 LSN 也不可信
+  for (auto pos : records) {
+    LogRecordHeader hdr;
+    memcpy(&hdr, &log[pos], sizeof(hdr));
+    uint64_t lsn = start_lsn_ + pos;
+    const char* body = &log[pos + sizeof(hdr)];
+    size_t body_len = hdr.size - sizeof(hdr);
+
+    if (hdr.type == kLogPage || hdr.type == kLogPageImage ||
+        hdr.type == kLogInitPage) {
+      recovered_lsns_[hdr.table_id] = lsn;
+      char* page = pages.get(hdr.table_id, hdr.file_type, hdr.page_no);
+      if (page == nullptr) return true;
+
+      if (hdr.type == kLogPageImage) {
+        memcpy(page, body, PAGE_SIZE);
+        body += PAGE_SIZE;
+      } else if (hdr.type == kLogInitPage) {
+        memset(page, 0, PAGE_SIZE);
+      } else if (PageLsn(page) >= lsn) {
+        continue;
+      }
+      for (int i = 0; i < hdr.range_cnt; i++) {
+        LogRange range;
+        memcpy(&range, body, sizeof(range));
+        memcpy(page + range.offset, body + sizeof(range) + range.len,
+               range.len);
+        body += sizeof(range) + range.len * 2;
+      }
+      SetPageLsn(page, lsn);
+    } else if (hdr.type == kLogCreateTable) {
+      RecoverCreateTable(body, body_len);
+    } else if (hdr.type == kLogDropTable) {
+      RecoverDropTable(hdr.table_id, body, body_len);
+    }
+  }
+
+  // undo: 按逆序撤销没有提交的事务。同一时间只有一个事务，没有提交的
+  // 事务一定是日志中最后一个事务，撤销时不会覆盖已提交事务的修改
+  for (auto iter = records.rbegin(); iter != records.rend(); iter++) {
+    LogRecordHeader hdr;
+    memcpy(&hdr, &log[*iter], sizeof(hdr));
+    if (committed.count(hdr.trx_id) > 0) continue;
+    const char* body = &log[*iter + sizeof(hdr)];
+    size_t body_len = hdr.size - sizeof(hdr);
+
+    if (hdr.type == kLogPage || hdr.type == kLogPageImage) {
+      char* page = pages.get(hdr.table_id, hdr.file_type, hdr.page_no);
+      if (page == nullptr) return true;
+
+      if (hdr.type == kLogPageImage) body += PAGE_SIZE;
+      std::vector<const char*> ranges;
+      for (int i = 0; i < hdr.range_cnt; i++) {
+        ranges.emplace_back(body);
+        LogRange range;
+        memcpy(&range, body, sizeof(range));
+        body += sizeof(range) + range.len * 2;
+      }
+      for (auto range_iter = ranges.rbegin(); range_iter != ranges.rend();
+           range_iter++) {
+        LogRange range;
+        memcpy(&range, *range_iter, sizeof(range));
+        memcpy(page + range.offset, *range_iter + sizeof(range), range.len);
+      }
+    } else if (hdr.type == kLogCreateTable) {
+      RecoverDropTable(hdr.table_id, body, body_len);
+    } else if (hdr.type == kLogDropTable) {
+      RecoverCreateTable(body, body_len);
+    }
+  }
+
+  recovering_ = false;
+  if (pages.writeAll()) return true;
+
+  // 恢复后的数据已经全部写回，从日志的结尾开始新的日志
+  file_size_ = pos;
+  durable_lsn_ = next_lsn_ = start_lsn_ + pos;
+  return truncate(next_lsn_);
+}
+
+bool PageLog::begin(Frame* frame, bool init) {
+  if (frame_ == frame) return false;
+  if (frame_ != nullptr) end();
+
+  if (before_ == nullptr) {
+    before_ = static_cast<char*>(malloc(PAGE_SIZE));
+    if (before_ == nullptr) {
+      std::cout << "[LiteDB-Error]  Failed to malloc " << PAGE_SIZE
+                << " bytes\r\n";
+      return true;
+    }
+  }
+
+  if (init) {
+    uint64_t lsn = g_wal.logInitPage(table_id_, file_type_, frame->page_no);
+    SetPageLsn(frame->data, lsn);
+  }
+  // 新分配的页已经是脏页，初始化的记录就是它的整页内容
+  image_ = !g_buffer_pool.isDirty(frame);
+  memcpy(before_, frame->data, PAGE_SIZE);
+  frame_ = frame;
+  return false;
+}
+
+void PageLog::end() {
+  if (frame_ == nullptr) return;
+
+  // 页头的 LSN 不写入日志，从 8 字节开始比较
+  std::vector<LogRange> ranges;
+  const char* after = frame_->data;
+  for (int off = 8; off < PAGE_SIZE; off += 8) {
+    if (memcmp(before_ + off, after + off, 8) == 0) continue;
+
+    if (!ranges.empty() &&
+        off - (ranges.back().offset + ranges.back().len) <= WAL_RANGE_GAP)
+      ranges.back().len = off + 8 - ranges.back().offset;
+    else
+      ranges.push_back({static_cast<uint16_t>(off), 8});
+  }
+
+  // 没有修改时页也已经标记为脏页，整页的内容仍然要记录
+  if (!ranges.empty() || image_) {
+    uint64_t lsn = g_wal.logPage(table_id_, file_type_, frame_->page_no,
+                                 ranges, before_, after, image_);
+    if (lsn != 0) SetPageLsn(frame_->data, lsn);
+  }
+  frame_ = nullptr;
+}
+
+}  // namespace litedb
\ No newline at end of file
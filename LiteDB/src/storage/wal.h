@@ -0,0 +1,180 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "storage/buffer_pool.h"
+#include "storage/disk.h"
+
+namespace litedb {
+
+class Table;
+
+// 日志超过这个大小时，提交后唤醒后台检查点线程
+#define WAL_CHECKPOINT_SIZE (64 * 1024 * 1024)
+
+// 数据页所在的文件
+enum PageFileType : uint8_t { kTableFile, kStringFile };
+
+enum LogRecordType : uint8_t {
+  kLogPage,         // 页内若干字节区间修改前后的内容
+  kLogInitPage,     // 新分配的页，内容全部置 0
+  kLogCommit,       // 事务提交
+  kLogCreateTable,  // 新建表，记录表的定义
+  kLogDropTable,    // 删除表，记录表的定义
+  kLogPageImage,    // 同 kLogPage，之前先记录修改前的整页内容
+};
+
+// 日志记录头。记录的 LSN 是它在日志中的位置，不保存在记录中；checksum
+// 覆盖 checksum 之后的全部内容，用来识别崩溃时没有写完的记录。
+struct LogRecordHeader {
+  uint32_t size;
+  uint32_t checksum;
+  uint64_t trx_id;
+  uint8_t type;
+  uint8_t file_type;
+  uint16_t range_cnt;
+  uint32_t table_id;
+  uint32_t page_no;
+  uint32_t reserved;
+};
+
+// kLogPage 记录中一个字节区间的位置，之后依次是修改前和修改后的内容
+struct LogRange {
+  uint16_t offset;
+  uint16_t len;
+};
+
+// redo/undo 日志。每个事务对页的修改都以物理的字节区间记录，提交时追加一条
+// 提交记录并 fsync 日志。数据页只在淘汰和检查点时写回，写回前日志必须已经
+// 持久化到页的 LSN。启动时按 ARIES 的方式恢复：先按顺序重做 LSN 大于页
+// LSN 的记录，再按逆序用修改前的内容撤销没有提交的事务。
+// 页写回时可能只写了一部分 (torn page)，数据文件中的页不一定可信。页从干净
+// 变脏后的第一次修改会记录整页的内容，新分配的页记录为全 0，恢复时从这里
+// 重建页，不看数据文件中的页。写回之后页变干净，它的日志要等写回持久化后
+// 才能截断，所以写回的页在日志中总有一份完整的内容。
+// 事务之外的每条语句是一个单独的事务。运行时的回滚通过内存中的 undo 完成，
+// 回滚产生的修改同样写入日志，回滚的事务最后也会追加提交记录。
+//
+// 日志由单独的写线程写入文件 (group commit)：提交时只把提交记录追加到
+// 内存中，然后等待写线程持久化。写线程每次把积累的全部日志用一次 fdatasync
+// 写入，由提交唤醒时先等待 g_commit_delay 微秒，让间隔很近的提交共用同一次
+// fsync。提交返回时日志一定已经持久化。
+class Wal {
+ public:
+  Wal() : fd_(-1), start_lsn_(1), next_lsn_(1), trx_first_lsn_(0),
+          file_size_(0), durable_lsn_(0), flush_lsn_(0), group_commit_(false),
+          writing_(false), failed_(false), stop_(false), trx_id_(1),
+          trx_logged_(false), recovering_(false) {}
+  ~Wal();
+
+  // 打开数据目录下的日志，并根据日志恢复所有的表和 catalog
+  bool open();
+
+  // image 为 true 时记录修改前的整页内容 before
+  uint64_t logPage(uint32_t table_id, PageFileType file_type,
+                   uint32_t page_no, const std::vector<LogRange>& ranges,
+                   const char* before, const char* after, bool image);
+  uint64_t logInitPage(uint32_t table_id, PageFileType file_type,
+                       uint32_t page_no);
+  bool logCreateTable(Table* table);
+  bool logDropTable(Table* table);
+
+  // 提交当前事务，返回前日志已经持久化
+  bool commit();
+  // 持久化全部日志
+  bool flush();
+  // 保证 LSN 不超过 lsn 的日志已经持久化，写回数据页之前调用
+  bool flushTo(uint64_t lsn);
+  // 丢弃 LSN 小于 lsn 的日志。调用者保证这些日志对应的页都已经写回，
+  // 并且其中没有未提交事务的记录
+  bool truncate(uint64_t lsn);
+
+  // 下一条日志记录的 LSN
+  uint64_t nextLsn();
+  // 当前事务第一条日志记录的 LSN，没有事务时返回 nextLsn()
+  uint64_t activeTrxLsn();
+  uint64_t size();
+  // 恢复时日志中表 table_id 的最后一条页记录的 LSN，没有时返回 0
+  uint64_t recoveredLsn(uint32_t table_id);
+
+ private:
+  uint64_t append(LogRecordHeader* hdr, const std::string& body);
+  // 等待 LSN 小于 lsn 的日志全部持久化。commit 为 true 时写线程会等待
+  // g_commit_delay，合并之后的提交
+  bool waitDurable(uint64_t lsn, bool commit);
+  void writerLoop();
+  bool recover();
+  bool writeHeader(int fd, uint64_t start_lsn);
+
+  // 以下成员由 mutex_ 保护，写线程、检查点线程和执行语句的线程都会访问
+  int fd_;
+  // 日志文件中第一条记录的 LSN，截断日志后 LSN 继续递增
+  uint64_t start_lsn_;
+  uint64_t next_lsn_;
+  uint64_t trx_first_lsn_;
+  uint64_t file_size_;
+  uint64_t durable_lsn_;
+  // 等待持久化的最大 LSN
+  uint64_t flush_lsn_;
+  bool group_commit_;
+  // 写线程正在写文件，此时不能替换日志文件
+  bool writing_;
+  // 写日志失败后日志不再可用，之后的提交都会失败
+  bool failed_;
+  bool stop_;
+  // 还没有交给写线程的日志
+  std::string buf_;
+  std::mutex mutex_;
+  // 通知写线程有日志需要持久化
+  std::condition_variable flush_cv_;
+  // 通知等待的线程日志已经持久化
+  std::condition_variable durable_cv_;
+  std::thread writer_;
+
+  uint64_t trx_id_;
+  bool trx_logged_;
+  bool recovering_;
+  // 只在 open 时写入，之后只读
+  std::unordered_map<uint32_t, uint64_t> recovered_lsns_;
+};
+
+// 写线程合并提交的最长等待时间，单位是微秒，为 0 时不等待
+extern int g_commit_delay;
+
+extern Wal g_wal;
+
+// 记录 pin 住的页在修改前的内容，修改完成后把修改写入日志。每个 TableStore
+// 和 StringHeap 都有一个，对应它们 pin 住的页。
+class PageLog {
+ public:
+  PageLog() : table_id_(0), file_type_(kTableFile), frame_(nullptr),
+              before_(nullptr), image_(false) {}
+  ~PageLog() { free(before_); }
+
+  void setFile(uint32_t table_id, PageFileType file_type) {
+    table_id_ = table_id;
+    file_type_ = file_type;
+  }
+  // 修改 frame 之前调用。init 为 true 表示 frame 是新分配的页
+  bool begin(Frame* frame, bool init = false);
+  // frame 被 unpin 之前调用，把修改写入日志并更新页的 LSN
+  void end();
+  // 丢弃记录的内容，不写日志
+  void reset() { frame_ = nullptr; }
+
+ private:
+  uint32_t table_id_;
+  PageFileType file_type_;
+  Frame* frame_;
+  char* before_;
+  // frame 在 begin 时是干净的页，日志中要记录整页的内容
+  bool image_;
+};
+
+}  // namespace litedb
\ No newline at end of file
@@ -1,29 +1,38 @@
 #include "trx.h"
 
+#include <iostream>
+
 namespace litedb {
 Transaction g_transaction;
 
-void Transaction::addInsertUndo(TableStore* table_store, Tuple* tup) {
+void Transaction::addInsertUndo(TableStore* table_store, TupleId tid) {
+  Undo* undo = new Undo(kInsertUndo);
+  undo->tableStore = table_store;
+  undo->tids.emplace_back(tid);
+  undo_stack_.emplace(undo);
+}
+
+void Transaction::addInsertUndo(TableStore* table_store,
+                                std::vector<TupleId>& tids) {
   Undo* undo = new Undo(kInsertUndo);
   undo->tableStore = table_store;
-  undo->curTup = tup;
+  undo->tids.swap(tids);
   undo_stack_.emplace(undo);
 }
 
-void Transaction::addUpdateUndo(TableStore* table_store, Tuple* tup) {
+void Transaction::addUpdateUndo(TableStore* table_store, TupleId tid) {
   Undo* undo = new Undo(kUpdateUndo);
   undo->tableStore = table_store;
-  undo->oldTup = static_cast<Tuple*>(malloc(table_store->tupleSize()));
-  memcpy(undo->oldTup->data, tup->data,
-         table_store->tupleSize() - TUPLE_HEADER_SIZE);
-  undo->curTup = tup;
+  undo->oldData = static_cast<uchar*>(malloc(table_store->tupleSize()));
+  table_store->copyTupleData(tid, undo->oldData);
+  undo->tid = tid;
   undo_stack_.emplace(undo);
 }
 
-void Transaction::addDeleteUndo(TableStore* table_store, Tuple* tup) {
+void Transaction::addDeleteUndo(TableStore* table_store, TupleId tid) {
   Undo* undo = new Undo(kDeleteUndo);
   undo->tableStore = table_store;
-  undo->oldTup = tup;
+  undo->tid = tid;
   undo_stack_.emplace(undo);
 }
 
@@ -63,49 +72,102 @@ void Transaction::addDropIndexUndo(char* schema, char* name, Index* index) {
   undo_stack_.emplace(undo);
 }
 
-void Transaction::begin() { in_transaction_ = true; }
+void Transaction::addTruncateTableUndo(Table* table) {
+  Undo* undo = new Undo(kTruncateTableUndo);
+  undo->tables.emplace_back(table);
+  undo_stack_.emplace(undo);
+}
+
+void Transaction::begin() {
+  in_transaction_ = true;
+  in_statement_ = false;
+}
+
+void Transaction::beginStatement() { in_statement_ = true; }
 
-void Transaction::rollback() {
+// 撤销行的修改失败时，失败的 undo 和之前的 undo 都留在栈中，事务保持打开，
+// 可以再次回滚。语句回滚失败时转为事务，由 ROLLBACK 重试
+bool Transaction::rollback() {
   while (!undo_stack_.empty()) {
     auto undo = undo_stack_.top();
     TableStore* table_store = undo->tableStore;
-    undo_stack_.pop();
+    bool err = false;
     // 根据 Undo 的类型决定对储存下来的数据有何改变。
     switch (undo->type) {
-      case kInsertUndo:
-        table_store->removeTuple(undo->curTup);
+      case kInsertUndo: {
+        // 已经删除的行从 undo 中去掉，再次回滚时不会重复删除
+        size_t removed = 0;
+        while (removed < undo->tids.size() &&
+               !table_store->removeTuple(undo->tids[removed]))
+          removed++;
+        undo->tids.erase(undo->tids.begin(), undo->tids.begin() + removed);
+        err = !undo->tids.empty();
         break;
+      }
       case kDeleteUndo:
-        table_store->recoverTuple(undo->oldTup);
+        err = table_store->recoverTuple(undo->tid);
         break;
       case kUpdateUndo:
-        memcpy(undo->curTup->data, undo->oldTup->data,
-               table_store->tupleSize() - TUPLE_HEADER_SIZE);
+        err = table_store->restoreTupleData(undo->tid, undo->oldData);
         break;
       case kCreateTableUndo:
         g_meta_data.dropTable(undo->schema, undo->name);
         break;
       case kCreateIndexUndo:
-        g_meta_data.dropIndex(undo->schema, undo->name, undo->index_name);
+        g_meta_data.dropIndex(undo->index_name);
         break;
       case kDropSchemaUndo:
       case kDropTableUndo:
         for (const auto table : undo->tables) g_meta_data.insertTable(table);
         break;
       case kDropIndexUndo: {
+        // 重新构建索引的数据
         Table* table = g_meta_data.getTable(undo->schema, undo->name);
-        table->addIndex(undo->index);
+        if (g_meta_data.createIndex(table, undo->index)) delete undo->index;
+        break;
+      }
+      case kTruncateTableUndo: {
+        // 删除替换上的空表，换回原来的表
+        Table* table = undo->tables[0];
+        g_meta_data.dropTable(table->schema(), table->name());
+        g_meta_data.insertTable(table);
         break;
       }
       default:
         break;
     }
+    if (err) {
+      std::cout << "[LiteDB-Error]  Failed to roll back the transaction\r\n";
+      in_transaction_ = true;
+      in_statement_ = false;
+      return true;
+    }
+    undo_stack_.pop();
     delete undo;
   }
   in_transaction_ = false;
+  in_statement_ = false;
+  return false;
 }
 
-void Transaction::commit() {
+// 先提交日志，失败时保留 undo，事务仍然打开，可以回滚。释放的修改记录在
+// 新的日志事务中，由之后的提交持久化
+bool Transaction::commit() {
+  if (g_meta_data.commit()) {
+    std::cout << "[LiteDB-Error]  Failed to commit the transaction\r\n";
+    return true;
+  }
+  return release();
+}
+
+bool Transaction::endStatement() { return release(); }
+
+// 释放槽位或字符串失败时继续处理其他的 undo，最后返回错误。没有释放的
+// 槽位由 VACUUM 回收
+bool Transaction::release() {
+  bool err = false;
+  // 之前的 undo 可能还引用删除的表，全部处理完之后再释放
+  std::vector<Table*> dropped;
   while (!undo_stack_.empty()) {
     auto undo = undo_stack_.top();
     TableStore* table_store = undo->tableStore;
@@ -113,11 +175,15 @@ void Transaction::commit() {
     // 根据 Undo 的类型决定哪些内存需要释放。
     switch (undo->type) {
       case kDeleteUndo:
-        table_store->freeTuple(undo->oldTup);
+        err = table_store->freeTuple(undo->tid) || err;
+        break;
+      case kUpdateUndo:
+        err = table_store->releaseTupleData(undo->tid, undo->oldData) || err;
         break;
       case kDropSchemaUndo:
       case kDropTableUndo:
-        for (const auto table : undo->tables) delete table;
+      case kTruncateTableUndo:
+        for (const auto table : undo->tables) dropped.emplace_back(table);
         break;
       case kDropIndexUndo:
         delete undo->index;
@@ -127,7 +193,10 @@ void Transaction::commit() {
     }
     delete undo;
   }
+  for (auto table : dropped) delete table;
   in_transaction_ = false;
+  in_statement_ = false;
+  return err;
 }
 
 }  // namespace litedb
\ No newline at end of file
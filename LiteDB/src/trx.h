@@ -17,29 +17,29 @@ enum UndoType {
   kDropSchemaUndo,
   kDropTableUndo,
   kDropIndexUndo,
+  kTruncateTableUndo,
 };
 
 struct Undo {
-  Undo(UndoType t)
-      : type(t), tableStore(nullptr), curTup(nullptr), oldTup(nullptr) {}
+  Undo(UndoType t) : type(t), tableStore(nullptr), oldData(nullptr) {}
   ~Undo() {
     // 根据 Undo 的类型进行一些内存释放
     switch (type) {
       case kUpdateUndo:
-        free(oldTup);
+        free(oldData);
         break;
       case kCreateTableUndo:
-        delete schema;
-        delete name;
+        free(schema);
+        free(name);
         break;
       case kCreateIndexUndo:
-        delete schema;
-        delete name;
-        delete index_name;
+        free(schema);
+        free(name);
+        free(index_name);
         break;
       case kDropIndexUndo:
-        delete schema;
-        delete name;
+        free(schema);
+        free(name);
         break;
       default:
         break;
@@ -48,8 +48,9 @@ struct Undo {
 
   UndoType type;
   TableStore* tableStore;
-  Tuple* curTup;
-  Tuple* oldTup;
+  TupleId tid;
+  std::vector<TupleId> tids;  // 插入的行，批量插入时一条 undo 对应多行
+  uchar* oldData;
   char* schema;
   char* name;
   char* index_name;
@@ -59,26 +60,36 @@ struct Undo {
 
 class Transaction {
  public:
-  Transaction() : in_transaction_(false) {}
+  Transaction() : in_transaction_(false), in_statement_(false) {}
   ~Transaction() {}
 
-  void addInsertUndo(TableStore* table_store, Tuple* tup);
-  void addDeleteUndo(TableStore* table_store, Tuple* tup);
-  void addUpdateUndo(TableStore* table_store, Tuple* tup);
+  void addInsertUndo(TableStore* table_store, TupleId tid);
+  void addInsertUndo(TableStore* table_store, std::vector<TupleId>& tids);
+  void addDeleteUndo(TableStore* table_store, TupleId tid);
+  void addUpdateUndo(TableStore* table_store, TupleId tid);
   void addCreateTableUndo(char* schema, char* name);
   void addCreateIndexUndo(char* schema, char* name, char* index_name);
   void addDropSchemaUndo(std::vector<Table*>* table);
   void addDropTableUndo(Table* table);
   void addDropIndexUndo(char* schema, char* table_name, Index* index);
+  void addTruncateTableUndo(Table* table);
 
   void begin();
-  void rollback();
-  void commit();
+  bool rollback();
+  bool commit();
+  // 事务之外的语句同样记录行的 undo，失败时由 rollback 撤销。成功时调用
+  // endStatement 释放删除的行和旧的字符串，和语句的修改一起提交
+  void beginStatement();
+  bool endStatement();
 
   bool inTransaction() { return in_transaction_; }
+  bool recordingUndo() { return in_transaction_ || in_statement_; }
 
  private:
+  bool release();
+
   bool in_transaction_;
+  bool in_statement_;
   std::stack<Undo*> undo_stack_;
 };
 
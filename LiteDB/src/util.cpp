@@ -177,7 +177,7 @@ size_t ColumnTypeSize(ColumnType& type) {
     case DataType::CHAR:
       return type.length + 1;
     case DataType::VARCHAR:
-      return type.length + 1;
+      return sizeof(VarcharSlot);
     default:
       return -1;
   }
@@ -192,9 +192,32 @@ INT64_MAX: 9,223,372,036,854,775,807
 #define MAX_INT64_LEN 20
 #define MIN_DOUBLE_LEN 10
 
+// 把存储中的列值转换成 Expr，只在输出结果时使用
+static Expr* MakeColumnExpr(const TupleView& tup, size_t idx, DataType type) {
+  if (tup.isNull(idx)) return Expr::makeNullLiteral();
+
+  switch (type) {
+    case DataType::INT:
+      return Expr::makeLiteral(static_cast<int64_t>(tup.getInt(idx)));
+    case DataType::LONG:
+      return Expr::makeLiteral(tup.getLong(idx));
+    case DataType::DOUBLE:
+      return Expr::makeLiteral(tup.getDouble(idx));
+    case DataType::CHAR:
+      return Expr::makeLiteral(strdup(tup.getChar(idx)));
+    case DataType::VARCHAR: {
+      uint32_t len;
+      const char* str = tup.getVarchar(idx, &len);
+      return Expr::makeLiteral(strndup(str, len));
+    }
+    default:
+      return Expr::makeNullLiteral();
+  }
+}
+
 void PrintTuples(std::vector<ColumnDefinition*>& columns,
                  std::vector<size_t>& colIds,
-                 std::vector<std::vector<Expr*>>& tuples) {
+                 std::vector<TupleView>& tuples) {
   if (tuples.size() == 0) {
     std::cout << "Empty set\r\n";
     return;
@@ -230,9 +253,9 @@ void PrintTuples(std::vector<ColumnDefinition*>& columns,
   std::cout << std::string(total_len, '-') << "\r\n";
 
   // 打印数据
-  for (auto tup : tuples) {
+  for (auto& tup : tuples) {
     for (size_t i = 0; i < columns.size(); i++) {
-      Expr* expr = tup[colIds[i]];
+      Expr* expr = MakeColumnExpr(tup, colIds[i], columns[i]->type.data_type);
       std::cout.width(col_lens[i]);
       switch (expr->type) {
         case kExprLiteralString:
@@ -251,6 +274,7 @@ void PrintTuples(std::vector<ColumnDefinition*>& columns,
         default:
           break;
       }
+      delete expr;
     }
     std::cout << "\r\n";
   }
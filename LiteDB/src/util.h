@@ -38,6 +38,6 @@ size_t ColumnTypeSize(ColumnType& type);
 
 void PrintTuples(std::vector<ColumnDefinition*>& columns,
                  std::vector<size_t>& colIds,
-                 std::vector<std::vector<Expr*>>& tuples);
+                 std::vector<TupleView>& tuples);
 
 }  // namespace litedb
\ No newline at end of file
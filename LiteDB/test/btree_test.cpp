@@ -0,0 +1,221 @@
+// Release 构建定义了 NDEBUG，测试中的 assert 仍然要生效
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "storage/btree.h"
+
+#define PRINT(a) \
+  fprintf(stderr, "\033[33m%s\033[0m \033[32m%s\033[0m\n", a, "Passed")
+
+using litedb::BPlusTree;
+
+// 和表上的索引一样，键是列值的编码加上行号，列值可以重复
+static std::string IndexKey(int64_t val, uint64_t tid) {
+  std::string key;
+  litedb::EncodeKeyInt(val, &key);
+  litedb::EncodeKeyUint64(tid, &key);
+  return key;
+}
+
+static std::string ColumnKey(int64_t val) {
+  std::string key;
+  litedb::EncodeKeyInt(val, &key);
+  return key;
+}
+
+// 按键的顺序比较树中的所有项和 oracle
+static void CheckAll(const BPlusTree& tree,
+                     const std::multimap<int64_t, uint64_t>& oracle) {
+  std::map<std::string, uint64_t> expected;
+  for (auto& entry : oracle)
+    expected.emplace(IndexKey(entry.first, entry.second), entry.second);
+
+  assert(tree.size() == oracle.size());
+  auto iter = tree.begin();
+  for (auto& entry : expected) {
+    assert(iter.valid());
+    assert(iter.key() == entry.first);
+    assert(iter.value() == entry.second);
+    iter.next();
+  }
+  assert(!iter.valid());
+}
+
+// 从 lowerBound(val) 开始是第一个不小于 val 的列值，相同的列值按行号排列
+static void CheckLowerBound(const BPlusTree& tree,
+                            const std::multimap<int64_t, uint64_t>& oracle,
+                            int64_t val) {
+  auto first = oracle.lower_bound(val);
+  auto iter = tree.lowerBound(ColumnKey(val));
+  if (first == oracle.end()) {
+    assert(!iter.valid());
+    return;
+  }
+
+  std::string prefix = ColumnKey(first->first);
+  std::vector<uint64_t> tids;
+  for (auto it = first; it != oracle.end() && it->first == first->first; it++)
+    tids.emplace_back(it->second);
+  std::sort(tids.begin(), tids.end());
+
+  for (auto tid : tids) {
+    assert(iter.valid());
+    assert(iter.key() == IndexKey(first->first, tid));
+    assert(iter.key().compare(0, prefix.size(), prefix) == 0);
+    assert(iter.value() == tid);
+    iter.next();
+  }
+  if (iter.valid()) assert(iter.key().compare(0, prefix.size(), prefix) > 0);
+}
+
+// 随机插入、删除和查找，取值范围小，列值大量重复。删除多于插入的阶段让
+// 节点借键、合并，树的高度降低
+static void RandomOps(BPlusTree* tree,
+                      std::multimap<int64_t, uint64_t>* oracle,
+                      std::mt19937* rng, int ops, int insert_pct,
+                      uint64_t* next_tid) {
+  std::uniform_int_distribution<int64_t> vals(-500, 500);
+  std::uniform_int_distribution<int> pct(0, 99);
+  for (int i = 0; i < ops; i++) {
+    int op = pct(*rng);
+    int64_t val = vals(*rng);
+    if (op < insert_pct || oracle->empty()) {
+      uint64_t tid = (*next_tid)++;
+      assert(!tree->insert(IndexKey(val, tid), tid));
+      oracle->emplace(val, tid);
+    } else if (op < insert_pct + 5) {
+      // 已经存在的键插入失败，不存在的键删除失败
+      auto it = oracle->begin();
+      std::advance(it, (*rng)() % oracle->size());
+      assert(tree->insert(IndexKey(it->first, it->second), 0));
+      assert(tree->remove(IndexKey(val, *next_tid)));
+    } else if (op < 90) {
+      auto it = oracle->begin();
+      std::advance(it, (*rng)() % oracle->size());
+      assert(!tree->remove(IndexKey(it->first, it->second)));
+      oracle->erase(it);
+    } else {
+      CheckLowerBound(*tree, *oracle, val);
+    }
+    assert(tree->size() == oracle->size());
+    if (i % 1000 == 0) CheckAll(*tree, *oracle);
+  }
+  CheckAll(*tree, *oracle);
+}
+
+int main(int argc, char* argv[]) {
+  {
+    BPlusTree tree;
+    assert(tree.size() == 0);
+    assert(!tree.begin().valid());
+    assert(!tree.lowerBound(ColumnKey(1)).valid());
+    assert(tree.remove(ColumnKey(1)));
+    PRINT("EmptyTree");
+  }
+
+  {
+    BPlusTree tree;
+    std::multimap<int64_t, uint64_t> oracle;
+    std::mt19937 rng(20240501);
+    uint64_t next_tid = 1;
+    RandomOps(&tree, &oracle, &rng, 20000, 60, &next_tid);
+    PRINT("RandomInsertRemove");
+
+    RandomOps(&tree, &oracle, &rng, 20000, 20, &next_tid);
+    PRINT("RandomShrink");
+
+    for (int64_t val = -510; val <= 510; val++)
+      CheckLowerBound(tree, oracle, val);
+    PRINT("LowerBound");
+
+    while (!oracle.empty()) {
+      auto it = oracle.begin();
+      std::advance(it, rng() % oracle.size());
+      assert(!tree.remove(IndexKey(it->first, it->second)));
+      oracle.erase(it);
+    }
+    CheckAll(tree, oracle);
+    assert(tree.nodeCount() == 1);
+    PRINT("RemoveAll");
+  }
+
+  {
+    // 每个节点的键数都在 [fill_factor%, 100%] 附近，填充越少节点越多
+    const size_t cnt = 10000;
+    size_t prev_nodes = 0;
+    for (int fill_factor : {100, 90, 70, 50}) {
+      std::vector<std::pair<std::string, uint64_t>> entries;
+      std::multimap<int64_t, uint64_t> oracle;
+      for (size_t i = 0; i < cnt; i++) {
+        int64_t val = static_cast<int64_t>(i / 3);
+        entries.emplace_back(IndexKey(val, i), i);
+        oracle.emplace(val, i);
+      }
+
+      BPlusTree tree;
+      tree.insert(IndexKey(-1, 0), 0);
+      tree.bulkLoad(&entries, fill_factor);
+      assert(entries.empty());
+      CheckAll(tree, oracle);
+
+      size_t target = BTREE_NODE_KEYS * fill_factor / 100;
+      if (target < BTREE_NODE_KEYS / 2) target = BTREE_NODE_KEYS / 2;
+      size_t leaves = (cnt + target - 1) / target;
+      // 内部节点的扇出不小于 BTREE_NODE_KEYS / 2
+      assert(tree.nodeCount() >= leaves);
+      assert(tree.nodeCount() <= leaves + leaves / (BTREE_NODE_KEYS / 2) + 2);
+      assert(tree.nodeCount() > prev_nodes);
+      prev_nodes = tree.nodeCount();
+
+      // 构建之后的树可以继续修改
+      std::mt19937 rng(fill_factor);
+      uint64_t next_tid = cnt;
+      RandomOps(&tree, &oracle, &rng, 5000, 50, &next_tid);
+    }
+    PRINT("BulkLoadFillFactor");
+  }
+
+  {
+    // 100% 填充时插入会立即分裂，50% 填充时节点有空位
+    std::vector<std::pair<std::string, uint64_t>> full, half;
+    for (uint64_t i = 0; i < 6400; i++) {
+      full.emplace_back(IndexKey(static_cast<int64_t>(i * 2), i), i);
+      half.emplace_back(IndexKey(static_cast<int64_t>(i * 2), i), i);
+    }
+    BPlusTree full_tree, half_tree;
+    full_tree.bulkLoad(&full, 100);
+    half_tree.bulkLoad(&half, 50);
+    size_t full_nodes = full_tree.nodeCount();
+    size_t half_nodes = half_tree.nodeCount();
+    for (uint64_t i = 0; i < 6400; i += 64) {
+      std::string key = IndexKey(static_cast<int64_t>(i * 2 + 1), i);
+      assert(!full_tree.insert(key, i));
+      assert(!half_tree.insert(key, i));
+    }
+    assert(full_tree.nodeCount() > full_nodes);
+    assert(half_tree.nodeCount() == half_nodes);
+    PRINT("BulkLoadSplit");
+  }
+
+  {
+    std::vector<std::pair<std::string, uint64_t>> entries;
+    BPlusTree tree;
+    tree.bulkLoad(&entries, 90);
+    assert(tree.size() == 0 && !tree.begin().valid());
+    entries.emplace_back(ColumnKey(7), 7);
+    tree.bulkLoad(&entries, 90);
+    assert(tree.size() == 1 && tree.begin().value() == 7);
+    assert(tree.nodeCount() == 1);
+    PRINT("BulkLoadSmall");
+  }
+
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,163 @@
+// Release 构建定义了 NDEBUG，测试中的 assert 仍然要生效
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "storage/compress.h"
+
+#define PRINT(a) \
+  fprintf(stderr, "\033[33m%s\033[0m \033[32m%s\033[0m\n", a, "Passed")
+
+using litedb::EncodedColumn;
+
+// 编码之后的数据之后放一段哨兵，检查编码没有写出 ChooseEncoding 返回的大小
+#define GUARD_BYTES 64
+#define GUARD_BYTE 0x5a
+
+// 按 ChooseEncoding 的选择编码再逐个解码，返回选择的编码。plain_size 默认
+// 比 8 字节的原始数据稍大，64 位宽的值也会压缩
+static int RoundTrip(const std::vector<int64_t>& values, size_t plain_size = 0,
+                     EncodedColumn* out_col = nullptr) {
+  if (plain_size == 0) plain_size = values.size() * 8 + 8;
+  EncodedColumn col;
+  size_t size =
+      litedb::ChooseEncoding(values.data(), values.size(), plain_size, &col);
+  if (out_col != nullptr) *out_col = col;
+  assert(size <= plain_size);
+  if (col.encoding == litedb::kPlainEncoding) {
+    assert(size == plain_size);
+    return col.encoding;
+  }
+
+  // 解码按 uint64_t 读，数据要按 8 字节对齐
+  std::vector<uint64_t> buf((size + GUARD_BYTES) / 8 + 1);
+  char* data = reinterpret_cast<char*>(buf.data());
+  memset(data, GUARD_BYTE, buf.size() * 8);
+  litedb::EncodeValues(values.data(), values.size(), col, data);
+  for (size_t i = size; i < buf.size() * 8; i++)
+    assert(static_cast<uint8_t>(data[i]) == GUARD_BYTE);
+
+  for (size_t i = 0; i < values.size(); i++)
+    assert(litedb::DecodeValue(data, col, i) == values[i]);
+  return col.encoding;
+}
+
+int main(int argc, char* argv[]) {
+  {
+    EncodedColumn col;
+    assert(litedb::ChooseEncoding(nullptr, 0, 16, &col) == 16);
+    assert(col.encoding == litedb::kPlainEncoding);
+
+    // 所有值相同时宽度为 0，不占空间
+    std::vector<int64_t> values(100, -7);
+    assert(RoundTrip(values, 0, &col) == litedb::kBitPackEncoding);
+    assert(col.width == 0 && col.base == -7);
+    PRINT("ConstantValues");
+  }
+
+  {
+    // 每个宽度都有跨越 uint64_t 边界的值，base 为负数和正数各测一次。
+    // 63 和 64 位宽时只有 INT64_MIN 作为 base 不会溢出
+    std::mt19937_64 rng(20240701);
+    for (int width = 1; width <= 64; width++) {
+      int64_t min = std::numeric_limits<int64_t>::min();
+      for (int64_t base : {width < 63 ? -1000000007LL : min,
+                           width < 63 ? 12345LL : min}) {
+        uint64_t mask = (width == 64) ? ~0ULL : (1ULL << width) - 1;
+        std::vector<int64_t> values;
+        for (int i = 0; i < 257; i++)
+          values.emplace_back(
+              static_cast<int64_t>(static_cast<uint64_t>(base) +
+                                   (rng() & mask)));
+        // 保证最小值是 base，最大值正好用满 width 位
+        values[3] = base;
+        values[100] = static_cast<int64_t>(static_cast<uint64_t>(base) + mask);
+
+        EncodedColumn col;
+        assert(RoundTrip(values, 0, &col) == litedb::kBitPackEncoding);
+        assert(col.width == width && col.base == base);
+      }
+    }
+    PRINT("BitPackWidths");
+  }
+
+  {
+    // 64 位宽：范围覆盖整个 int64_t，base 是 INT64_MIN
+    std::vector<int64_t> values;
+    for (int i = 0; i < 64; i++) {
+      values.emplace_back(std::numeric_limits<int64_t>::min() + i);
+      values.emplace_back(std::numeric_limits<int64_t>::max() - i);
+      values.emplace_back(-i);
+    }
+    EncodedColumn col;
+    assert(RoundTrip(values, 0, &col) == litedb::kBitPackEncoding);
+    assert(col.width == 64);
+    assert(col.base == std::numeric_limits<int64_t>::min());
+
+    // 不比原始数据小时不压缩
+    assert(RoundTrip(values, values.size() * 8) == litedb::kPlainEncoding);
+    PRINT("Width64");
+  }
+
+  {
+    // 连续相等的值很多时选择 RLE，段的值同样按位压缩
+    std::vector<int64_t> values;
+    for (int run = 0; run < 20; run++)
+      values.insert(values.end(), 50 + run, -300 + run * 17);
+    EncodedColumn col;
+    assert(RoundTrip(values, 0, &col) == litedb::kRleEncoding);
+    assert(col.run_cnt == 20);
+    assert(col.base == -300);
+
+    // 段的值跨越 uint64_t 边界，并且用满 64 位
+    values.clear();
+    for (int run = 0; run < 40; run++) {
+      int64_t val = (run % 2 == 0) ? std::numeric_limits<int64_t>::min() + run
+                                   : std::numeric_limits<int64_t>::max() - run;
+      values.insert(values.end(), 30, val);
+    }
+    assert(RoundTrip(values, 0, &col) == litedb::kRleEncoding);
+    assert(col.width == 64 && col.run_cnt == 40);
+
+    // 长度为 1 的段
+    values.clear();
+    for (int i = 0; i < 200; i++) values.emplace_back(i < 190 ? 9 : i);
+    assert(RoundTrip(values, 0, &col) == litedb::kRleEncoding);
+    assert(col.run_cnt == 11);
+    PRINT("Rle");
+  }
+
+  {
+    // 随机的段长和取值范围，编码由 ChooseEncoding 决定
+    std::mt19937_64 rng(20240702);
+    int rle = 0, packed = 0;
+    for (int iter = 0; iter < 2000; iter++) {
+      int width = rng() % 65;
+      uint64_t mask = (width == 64) ? ~0ULL : (1ULL << width) - 1;
+      int64_t base = static_cast<int64_t>(rng());
+      size_t cnt = 1 + rng() % 1024;
+      size_t max_run = 1 + rng() % 64;
+      std::vector<int64_t> values;
+      while (values.size() < cnt) {
+        int64_t val =
+            static_cast<int64_t>(static_cast<uint64_t>(base) + (rng() & mask));
+        values.insert(values.end(),
+                      std::min(cnt - values.size(), 1 + rng() % max_run), val);
+      }
+
+      int encoding = RoundTrip(values);
+      if (encoding == litedb::kRleEncoding) rle++;
+      if (encoding == litedb::kBitPackEncoding) packed++;
+    }
+    assert(rle > 0 && packed > 0);
+    PRINT("RandomRoundTrip");
+  }
+
+  return 0;
+}
\ No newline at end of file
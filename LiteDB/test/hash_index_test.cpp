@@ -0,0 +1,132 @@
+// Release 构建定义了 NDEBUG，测试中的 assert 仍然要生效
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "storage/hash_index.h"
+
+#define PRINT(a) \
+  fprintf(stderr, "\033[33m%s\033[0m \033[32m%s\033[0m\n", a, "Passed")
+
+using litedb::HashIndex;
+
+typedef std::multimap<std::string, uint64_t> Oracle;
+
+static std::string Key(int val) { return "k" + std::to_string(val); }
+
+static void CheckLookup(const HashIndex& index, const Oracle& oracle,
+                        const std::string& key) {
+  std::vector<uint64_t> values, expected;
+  index.lookup(key, &values);
+  auto range = oracle.equal_range(key);
+  for (auto it = range.first; it != range.second; it++)
+    expected.emplace_back(it->second);
+  std::sort(values.begin(), values.end());
+  std::sort(expected.begin(), expected.end());
+  assert(values == expected);
+}
+
+// forEach 恰好访问每一项一次
+static void CheckAll(const HashIndex& index, const Oracle& oracle) {
+  assert(index.size() == oracle.size());
+  Oracle seen;
+  index.forEach([&seen](const std::string& key, uint64_t value) {
+    seen.emplace(key, value);
+  });
+  assert(seen.size() == oracle.size());
+  for (auto it = oracle.begin(); it != oracle.end();) {
+    CheckLookup(index, oracle, it->first);
+    it = oracle.upper_bound(it->first);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  {
+    HashIndex index;
+    std::vector<uint64_t> values;
+    index.lookup("k1", &values);
+    assert(values.empty());
+    assert(index.remove("k1", 1));
+    assert(index.size() == 0);
+    PRINT("EmptyIndex");
+  }
+
+  {
+    // 插入的过程中桶不断分裂，已经插入的键仍然能找到
+    HashIndex index;
+    Oracle oracle;
+    size_t init_bytes = index.memoryBytes();
+    int cnt = HASH_INDEX_LOAD * HASH_INDEX_SEGMENT_BUCKETS * 3;
+    for (int i = 0; i < cnt; i++) {
+      index.insert(Key(i), i);
+      oracle.emplace(Key(i), i);
+      if (i % 97 == 0) {
+        CheckLookup(index, oracle, Key(i / 2));
+        CheckLookup(index, oracle, Key(i));
+        CheckLookup(index, oracle, Key(i + 1));
+      }
+    }
+    CheckAll(index, oracle);
+    // 项和分裂时新分配的桶段都计入内存
+    assert(index.memoryBytes() > init_bytes);
+    PRINT("SplitLookup");
+
+    index.clear();
+    assert(index.size() == 0);
+    assert(index.memoryBytes() == init_bytes);
+    std::vector<uint64_t> values;
+    index.lookup(Key(1), &values);
+    assert(values.empty());
+    PRINT("Clear");
+  }
+
+  {
+    // 键大量重复，删除要同时匹配键和值
+    HashIndex index;
+    Oracle oracle;
+    std::mt19937 rng(20240601);
+    std::uniform_int_distribution<int> keys(0, 300);
+    std::uniform_int_distribution<int> pct(0, 99);
+    uint64_t next_value = 1;
+    for (int i = 0; i < 30000; i++) {
+      int op = pct(rng);
+      std::string key = Key(keys(rng));
+      if (op < 55 || oracle.empty()) {
+        index.insert(key, next_value);
+        oracle.emplace(key, next_value++);
+      } else if (op < 60) {
+        // 键存在但值不同，或者键不存在
+        assert(index.remove(key, next_value));
+        assert(index.remove(Key(1000), 1));
+      } else if (op < 90) {
+        auto it = oracle.begin();
+        std::advance(it, rng() % oracle.size());
+        assert(!index.remove(it->first, it->second));
+        oracle.erase(it);
+      } else {
+        CheckLookup(index, oracle, key);
+      }
+      assert(index.size() == oracle.size());
+      if (i % 3000 == 0) CheckAll(index, oracle);
+    }
+    CheckAll(index, oracle);
+    PRINT("RandomInsertRemove");
+
+    while (!oracle.empty()) {
+      auto it = oracle.begin();
+      assert(!index.remove(it->first, it->second));
+      assert(index.remove(it->first, it->second));
+      oracle.erase(it);
+    }
+    CheckAll(index, oracle);
+    PRINT("RemoveAll");
+  }
+
+  return 0;
+}
\ No newline at end of file